@@ -0,0 +1,272 @@
+/* microbenchmarks for the sourdough and datagrump hot paths */
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <new>
+#include <vector>
+#include <memory>
+
+#include "address.hh"
+#include "socket.hh"
+#include "poller.hh"
+#include "timestamp.hh"
+#include "contest_message.hh"
+#include "controller.hh"
+#include "fec.hh"
+#include "util.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+/* count every heap allocation made by the program */
+static uint64_t allocation_count = 0;
+
+void * operator new( size_t size )
+{
+  allocation_count++;
+  void * const ret = malloc( size ? size : 1 );
+  if ( not ret ) {
+    throw bad_alloc();
+  }
+  return ret;
+}
+
+void operator delete( void * ptr ) noexcept { free( ptr ); }
+void operator delete( void * ptr, size_t ) noexcept { free( ptr ); }
+
+/* keep the compiler from optimizing away a result */
+template <typename T>
+inline void do_not_optimize( T & value )
+{
+  __asm__ __volatile__( "" : : "g"( &value ) : "memory" );
+}
+
+class Benchmark
+{
+private:
+  string filter_;
+
+public:
+  Benchmark( const string & filter ) : filter_( filter )
+  {
+    cout << left << setw( 40 ) << "benchmark"
+	 << right << setw( 12 ) << "iterations"
+	 << setw( 12 ) << "ns/op"
+	 << setw( 12 ) << "allocs/op" << endl;
+  }
+
+  /* run the function repeatedly for about a quarter second and report per-call costs */
+  template <typename Function>
+  void run( const string & name, Function && function )
+  {
+    if ( name.find( filter_ ) == string::npos ) {
+      return;
+    }
+
+    /* warm up and calibrate */
+    uint64_t iterations = 1;
+    chrono::nanoseconds elapsed { 0 };
+    while ( elapsed < chrono::milliseconds( 10 ) ) {
+      iterations *= 2;
+      const auto start = chrono::steady_clock::now();
+      for ( uint64_t i = 0; i < iterations; i++ ) {
+	function();
+      }
+      elapsed = chrono::steady_clock::now() - start;
+    }
+    iterations = max( uint64_t( 1 ), iterations * 250 / max( int64_t( 1 ), int64_t( chrono::duration_cast<chrono::milliseconds>( elapsed ).count() ) ) );
+
+    const uint64_t allocations_before = allocation_count;
+    const auto start = chrono::steady_clock::now();
+    for ( uint64_t i = 0; i < iterations; i++ ) {
+      function();
+    }
+    elapsed = chrono::steady_clock::now() - start;
+    const uint64_t allocations = allocation_count - allocations_before;
+
+    cout << left << setw( 40 ) << name
+	 << right << setw( 12 ) << iterations
+	 << setw( 12 ) << fixed << setprecision( 1 ) << double( elapsed.count() ) / iterations
+	 << setw( 12 ) << setprecision( 2 ) << double( allocations ) / iterations << endl;
+  }
+};
+
+static void bench_contest_message( Benchmark & bench )
+{
+  ContestMessage message( 12345, string( 1424, 'c' ) );
+  message.set_send_timestamp();
+  const string wire = message.to_string();
+
+  bench.run( "ContestMessage parse", [&] () {
+      ContestMessage parsed( wire );
+      do_not_optimize( parsed );
+    } );
+
+  bench.run( "ContestMessage serialize", [&] () {
+      string serialized = message.to_string();
+      do_not_optimize( serialized );
+    } );
+
+  bench.run( "Header::to_string", [&] () {
+      string serialized = message.header.to_string();
+      do_not_optimize( serialized );
+    } );
+}
+
+static void bench_fec( Benchmark & bench )
+{
+  vector<uint8_t> src( 1472, 0x5a ), dst( 1472 );
+
+  bench.run( "gf256_mul_add scalar (1472 B)", [&] () {
+      gf256_mul_add_scalar( dst.data(), src.data(), 0x8e, src.size() );
+      do_not_optimize( dst );
+    } );
+
+  bench.run( string( "gf256_mul_add " ) + gf256_kernel_name() + " (1472 B)", [&] () {
+      gf256_mul_add( dst.data(), src.data(), 0x8e, src.size() );
+      do_not_optimize( dst );
+    } );
+
+  FecEncoder encoder( FecParams( "rs:16:2" ) );
+  const string datagram = ContestMessage( 1, string( 1424 - FecParams::OVERHEAD, 'c' ) ).to_string();
+  uint64_t sequence_number = 0;
+  bench.run( "FecEncoder::add (rs:16:2)", [&] () {
+      vector<string> parity = encoder.add( sequence_number++, datagram );
+      do_not_optimize( parity );
+    } );
+}
+
+static void bench_udp( Benchmark & bench )
+{
+  UDPSocket receiver;
+  receiver.set_timestamps();
+  receiver.bind( Address( "127.0.0.1", 0 ) );
+
+  UDPSocket sender;
+  sender.connect( receiver.local_address() );
+
+  const string payload = ContestMessage( 1, string( 1424, 'c' ) ).to_string();
+
+  bench.run( "UDPSocket send+recv (loopback)", [&] () {
+      sender.send( payload );
+      UDPSocket::received_datagram recd = receiver.recv();
+      do_not_optimize( recd );
+    } );
+
+  vector<char> buffer( 65536 );
+  bench.run( "UDPSocket send+recv_into (loopback)", [&] () {
+      sender.send( payload );
+      UDPSocket::received_view recd = receiver.recv_into( buffer.data(), buffer.size() );
+      do_not_optimize( recd );
+    } );
+}
+
+static void bench_poller( Benchmark & bench, const unsigned int action_count )
+{
+  /* every socket is always writable, so every action fires on each poll */
+  vector<unique_ptr<UDPSocket>> sockets;
+  Poller poller;
+  uint64_t callbacks = 0;
+
+  for ( unsigned int i = 0; i < action_count; i++ ) {
+    sockets.emplace_back( new UDPSocket );
+    poller.add_action( Action( *sockets.back(), Direction::Out,
+			       [&] () { callbacks++; return ResultType::Continue; } ) );
+  }
+
+  bench.run( "Poller::poll (" + to_string( action_count ) + " actions)", [&] () {
+      poller.poll( 0 );
+    } );
+
+  do_not_optimize( callbacks );
+}
+
+static void bench_address( Benchmark & bench )
+{
+  bench.run( "Address(ip, port)", [&] () {
+      Address address( "127.0.0.1", 9090 );
+      do_not_optimize( address );
+    } );
+
+  const Address original( "127.0.0.1", 9090 );
+  bench.run( "Address(sockaddr, size)", [&] () {
+      Address address( original.to_sockaddr(), original.size() );
+      do_not_optimize( address );
+    } );
+}
+
+static void bench_timestamp( Benchmark & bench )
+{
+  bench.run( "timestamp_ms()", [&] () {
+      uint64_t now = timestamp_ms();
+      do_not_optimize( now );
+    } );
+}
+
+template <class ControllerType>
+static void bench_controller( Benchmark & bench, const string & name )
+{
+  ControllerType controller;
+
+  /* leave slow start with a steady 140 ms RTT, so every ack runs the CTCP update */
+  uint64_t sequence_number = 1, now = 0;
+  auto ack = [&] () {
+    controller.ack_received( sequence_number, now, now + 70, now + 140 );
+    sequence_number++;
+    now++;
+  };
+
+  for ( unsigned int i = 0; i < 10000; i++ ) {
+    ack();
+  }
+
+  bench.run( name + "::ack_received", ack );
+
+  double win = 100;
+  bench.run( name + "::update_dwnd", [&] () {
+      controller.update_dwnd( win, 1.0, false );
+      win += 0.01;
+    } );
+
+  bench.run( name + "::window_size", [&] () {
+      unsigned int window = controller.window_size();
+      do_not_optimize( window );
+    } );
+}
+
+int main( int argc, char *argv[] )
+{
+  /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc > 2 ) {
+    cerr << "Usage: " << argv[ 0 ] << " [FILTER]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    Benchmark bench( argc == 2 ? argv[ 1 ] : "" );
+
+    bench_contest_message( bench );
+    bench_fec( bench );
+    bench_udp( bench );
+    bench_poller( bench, 1 );
+    bench_poller( bench, 64 );
+    bench_address( bench );
+    bench_timestamp( bench );
+    bench_controller<Controller<CTCP>>( bench, "Controller<CTCP>" );
+    bench_controller<Controller<Reno>>( bench, "Controller<Reno>" );
+    bench_controller<Controller<CTCPLossDiff>>( bench, "Controller<CTCPLossDiff>" );
+    bench_controller<Controller<CTCPOneWay>>( bench, "Controller<CTCPOneWay>" );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "congestion_manager.hh"
+#include "controller.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const uint32_t CM_INITIALIZING = 1;
+static const uint32_t CM_READY = 0x636d6772; /* "cmgr" */
+
+static const double INITIAL_WINDOW = 2;
+static const double MIN_WINDOW = 2;
+static const uint64_t FLOW_TIMEOUT_MS = 2000; /* silent this long, a flow gets no share */
+
+/* the clock every process shares (the programs' own timestamps
+   each start from zero) */
+static uint64_t monotonic_ms()
+{
+  timespec ts;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &ts ) );
+  return uint64_t( ts.tv_sec ) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static double from_bits( const uint64_t bits )
+{
+  double value;
+  memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
+static uint64_t to_bits( const double value )
+{
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  return bits;
+}
+
+static double load_double( const atomic<uint64_t> & word )
+{
+  return from_bits( word.load( memory_order_relaxed ) );
+}
+
+static void store_double( atomic<uint64_t> & word, const double value )
+{
+  word.store( to_bits( value ), memory_order_relaxed );
+}
+
+/* replace a shared double with f( old value ), retrying if another flow got there first */
+template <typename Function>
+static double update_double( atomic<uint64_t> & word, Function && f )
+{
+  uint64_t old_bits = word.load( memory_order_relaxed );
+  double new_value;
+  do {
+    new_value = f( from_bits( old_bits ) );
+  } while ( not word.compare_exchange_weak( old_bits, to_bits( new_value ), memory_order_relaxed ) );
+  return new_value;
+}
+
+/* one macroflow per peer host (shared-memory names cannot hold
+   the separators in an address) */
+static string segment_name( const Address & peer )
+{
+  string name = peer.ip();
+  for ( char & c : name ) {
+    if ( not isalnum( c ) ) {
+      c = '_';
+    }
+  }
+  return "/datagrump_cm-" + name;
+}
+
+/* join the macroflow to this peer with a weight for its share */
+CongestionManager::CongestionManager( const Address & peer, const unsigned int weight )
+  : name_( segment_name( peer ) ),
+    region_(),
+    segment_( nullptr ),
+    slot_( MAX_FLOWS )
+{
+  if ( weight == 0 ) {
+    throw runtime_error( "congestion manager weight must be positive" );
+  }
+
+  FileDescriptor fd( SystemCall( "shm_open " + name_,
+				 shm_open( name_.c_str(), O_RDWR | O_CREAT, 0644 ) ) );
+  SystemCall( "ftruncate", ftruncate( fd.fd_num(), sizeof( Segment ) ) );
+  region_.reset( new MMapRegion( sizeof( Segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd_num() ) );
+  segment_ = reinterpret_cast<Segment *>( region_->addr() );
+
+  /* the first flow ever sets the segment up; the others wait for it */
+  uint32_t state = 0;
+  if ( segment_->state.compare_exchange_strong( state, CM_INITIALIZING ) ) {
+    reset_macroflow();
+    segment_->state.store( CM_READY, memory_order_release );
+  }
+  while ( (state = segment_->state.load( memory_order_acquire )) != CM_READY ) {
+    if ( state != CM_INITIALIZING ) {
+      throw runtime_error( name_ + " is not a datagrump congestion manager segment" );
+    }
+    this_thread::yield();
+  }
+
+  /* a macroflow with no live flows is left over from earlier runs */
+  const uint64_t now = monotonic_ms();
+  bool alone = true;
+  for ( const FlowSlot & flow : segment_->flows ) {
+    alone = alone and not is_live( flow, now );
+  }
+  if ( alone ) {
+    reset_macroflow();
+  }
+
+  /* take a free slot, or one whose process is gone */
+  for ( size_t i = 0; i < MAX_FLOWS and slot_ == MAX_FLOWS; i++ ) {
+    FlowSlot & flow = segment_->flows[ i ];
+    uint64_t pid = flow.pid.load();
+    if ( pid and kill( pid, 0 ) == 0 ) {
+      continue;
+    }
+    if ( flow.pid.compare_exchange_strong( pid, getpid() ) ) {
+      flow.weight.store( weight );
+      flow.heartbeat_ms.store( now );
+      slot_ = i;
+    }
+  }
+
+  if ( slot_ == MAX_FLOWS ) {
+    throw runtime_error( "congestion manager " + name_ + " has no free flow slot" );
+  }
+}
+
+/* leave the macroflow */
+CongestionManager::~CongestionManager()
+{
+  segment_->flows[ slot_ ].pid.store( 0 );
+}
+
+void CongestionManager::reset_macroflow()
+{
+  store_double( segment_->window, INITIAL_WINDOW );
+  store_double( segment_->ssthresh, INFINITY );
+  store_double( segment_->srtt, 0 );
+  store_double( segment_->min_rtt, INFINITY );
+  segment_->last_loss_ms.store( 0 );
+}
+
+bool CongestionManager::is_live( const FlowSlot & flow, const uint64_t now ) const
+{
+  const uint64_t pid = flow.pid.load( memory_order_relaxed );
+  return pid and (pid == uint64_t( getpid() )
+		  or flow.heartbeat_ms.load( memory_order_relaxed ) + FLOW_TIMEOUT_MS > now);
+}
+
+/* this flow's weighted share of the aggregate window, in datagrams */
+unsigned int CongestionManager::window_share()
+{
+  const uint64_t now = monotonic_ms();
+  FlowSlot & self = segment_->flows[ slot_ ];
+  self.heartbeat_ms.store( now, memory_order_relaxed );
+
+  uint64_t total_weight = 0;
+  for ( const FlowSlot & flow : segment_->flows ) {
+    if ( is_live( flow, now ) ) {
+      total_weight += flow.weight.load( memory_order_relaxed );
+    }
+  }
+
+  const double share = window() * self.weight.load( memory_order_relaxed ) / max( total_weight, uint64_t( 1 ) );
+  return max( 1u, static_cast<unsigned int>( share ) );
+}
+
+/* one of this flow's acks arrived (rtt in ms), after a gap if loss */
+void CongestionManager::ack_received( const double rtt, const bool loss )
+{
+  const uint64_t now = monotonic_ms();
+  segment_->flows[ slot_ ].heartbeat_ms.store( now, memory_order_relaxed );
+
+  const double min_rtt = update_double( segment_->min_rtt, [&] ( const double old ) { return min( old, rtt ); } );
+  const double srtt = update_double( segment_->srtt, [&] ( const double old ) {
+      return old == 0 ? rtt : ControllerDefaults::rtt_smooth * rtt + (1 - ControllerDefaults::rtt_smooth) * old;
+    } );
+
+  if ( loss ) {
+    /* the first flow to see a loss in each loss timeout halves the window */
+    uint64_t last_loss = segment_->last_loss_ms.load( memory_order_relaxed );
+    if ( now > last_loss + ControllerDefaults::loss_timeout
+	 and segment_->last_loss_ms.compare_exchange_strong( last_loss, now ) ) {
+      const double window = update_double( segment_->window, [] ( const double old ) {
+	  return max( old / 2, MIN_WINDOW );
+	} );
+      store_double( segment_->ssthresh, window );
+      segment_->loss_events.fetch_add( 1, memory_order_relaxed );
+    }
+    return;
+  }
+
+  const double ssthresh = load_double( segment_->ssthresh );
+  update_double( segment_->window, [&] ( const double old ) {
+      const double queued = old * (1 - min_rtt / srtt);
+      if ( queued >= 2 * CTCP::gamma ) {
+	return max( old - 1 / old, MIN_WINDOW );
+      } else if ( queued >= CTCP::gamma ) {
+	return old;
+      }
+      return old + (old < ssthresh ? 1 : 1 / old);
+    } );
+
+  /* a standing queue ends slow start, as a loss would */
+  if ( std::isinf( ssthresh ) and window() * (1 - min_rtt / srtt) >= CTCP::gamma ) {
+    store_double( segment_->ssthresh, window() );
+  }
+}
+
+/* this flow timed out waiting for acks */
+void CongestionManager::timed_out()
+{
+  const double window = update_double( segment_->window, [] ( const double old ) {
+      return max( old / 2, MIN_WINDOW );
+    } );
+  store_double( segment_->ssthresh, window );
+}
+
+double CongestionManager::window() const
+{
+  return load_double( segment_->window );
+}
+
+double CongestionManager::smoothed_rtt() const
+{
+  return load_double( segment_->srtt );
+}
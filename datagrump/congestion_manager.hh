@@ -0,0 +1,84 @@
+#ifndef CONGESTION_MANAGER_HH
+#define CONGESTION_MANAGER_HH
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "address.hh"
+#include "mmap_region.hh"
+
+/* Congestion manager, after RFC 3124: concurrent senders to the same
+   host form one macroflow with a single window and rtt estimate, kept
+   in a POSIX shared-memory segment named after the peer's address. Every
+   flow's acks and losses drive the shared window, and each flow sends
+   within its weighted share of it, so the flows stop competing for (and
+   each separately overfilling) the bottleneck queue. All shared state
+   is updated with atomic compare-and-swap; no flow ever waits on another.
+
+   The aggregate window grows like Reno, one datagram per window of acks
+   (doubling in slow start), but only while the queue it estimates,
+   window * (1 - min rtt / rtt), is below CTCP's gamma; beyond twice
+   that it shrinks. One loss per loss timeout halves it. */
+class CongestionManager
+{
+public:
+  static const size_t MAX_FLOWS = 16;
+
+private:
+  struct FlowSlot
+  {
+    std::atomic<uint64_t> pid; /* 0 if free */
+    std::atomic<uint64_t> weight;
+    std::atomic<uint64_t> heartbeat_ms; /* monotonic clock */
+  };
+
+  struct Segment
+  {
+    std::atomic<uint32_t> state; /* 0, then INITIALIZING, then ready */
+
+    /* doubles, stored as their bits */
+    std::atomic<uint64_t> window, ssthresh, srtt, min_rtt;
+
+    std::atomic<uint64_t> last_loss_ms;
+    std::atomic<uint64_t> loss_events;
+    FlowSlot flows[ MAX_FLOWS ];
+  };
+
+  std::string name_;
+  std::unique_ptr<MMapRegion> region_;
+  Segment * segment_;
+  size_t slot_;
+
+  void reset_macroflow();
+  bool is_live( const FlowSlot & flow, const uint64_t now ) const;
+
+public:
+  /* join the macroflow to this peer with a weight for its share */
+  CongestionManager( const Address & peer, const unsigned int weight );
+
+  /* leave the macroflow */
+  ~CongestionManager();
+
+  /* this flow's weighted share of the aggregate window, in datagrams */
+  unsigned int window_share();
+
+  /* one of this flow's acks arrived (rtt in ms), after a gap if loss */
+  void ack_received( const double rtt, const bool loss );
+
+  /* this flow timed out waiting for acks */
+  void timed_out();
+
+  /* accessors for live stats */
+  const std::string & name() const { return name_; }
+  double window() const;
+  double smoothed_rtt() const;
+  uint64_t loss_events() const { return segment_->loss_events.load( std::memory_order_relaxed ); }
+
+  /* forbid copying or assigning */
+  CongestionManager( const CongestionManager & other ) = delete;
+  CongestionManager & operator=( const CongestionManager & other ) = delete;
+};
+
+#endif /* CONGESTION_MANAGER_HH */
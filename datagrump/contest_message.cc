@@ -1,4 +1,5 @@
 #include <stdexcept>
+#include <cstring>
 
 #include "contest_message.hh"
 #include "timestamp.hh"
@@ -6,32 +7,151 @@
 using namespace std;
 
 /* helper to get the nth uint64_t field (in network byte order) */
-uint64_t get_header_field( const size_t n, const string & str )
+uint64_t get_header_field( const size_t n, const char * const data, const size_t length )
 {
-  if ( str.size() < (n + 1) * sizeof( uint64_t ) ) {
+  if ( length < (n + 1) * sizeof( uint64_t ) ) {
     throw runtime_error( "contest message too small to contain header" );
   }
 
-  const uint64_t * const data_ptr
-    = reinterpret_cast<const uint64_t *>( str.data() ) + n;
+  uint64_t network_order;
+  memcpy( &network_order, data + n * sizeof( uint64_t ), sizeof( network_order ) );
 
-  return be64toh( *data_ptr );
+  return be64toh( network_order );
 }
 
+static const uint64_t SEQUENCE_NUMBER_MASK = (uint64_t( 1 ) << 56) - 1;
+
+/* legacy format: the top byte of the first field */
+static const uint8_t LEGACY_OFFERS_COMPACT = 0x40;
+static const uint8_t LEGACY_CLASS_MASK = 0x3f;
+
+/* compact format: version byte, then flags */
+static const uint8_t COMPACT_MARKER = 0x80;
+static const uint8_t COMPACT_VERSION = 1;
+static const uint8_t COMPACT_CLASS_MASK = 0x03;
+static const uint8_t COMPACT_HAS_SEND_TIMESTAMP = 0x04;
+static const uint8_t COMPACT_HAS_ACK = 0x08;
+static const uint8_t COMPACT_HAS_CE_COUNT = 0x10;
+
+/* LEB128 varint */
+static size_t put_varint( uint64_t n, char * const out )
+{
+  size_t length = 0;
+  while ( n >= 0x80 ) {
+    out[ length++ ] = char( 0x80 | (n & 0x7f) );
+    n >>= 7;
+  }
+  out[ length++ ] = char( n );
+  return length;
+}
+
+static uint64_t get_varint( const char * const data, const size_t length, size_t & offset )
+{
+  uint64_t ret = 0;
+  for ( unsigned int shift = 0; shift < 64; shift += 7 ) {
+    if ( offset >= length ) {
+      throw runtime_error( "contest message too small to contain header" );
+    }
+    const uint8_t byte = data[ offset++ ];
+    ret |= uint64_t( byte & 0x7f ) << shift;
+    if ( not (byte & 0x80) ) {
+      return ret;
+    }
+  }
+
+  throw runtime_error( "contest message has malformed varint" );
+}
+
+/* map signed deltas to small unsigned numbers (0, -1, 1, -2, ...) */
+static uint64_t zigzag( const int64_t n ) { return (uint64_t( n ) << 1) ^ uint64_t( n >> 63 ); }
+static int64_t unzigzag( const uint64_t n ) { return int64_t( n >> 1 ) ^ -int64_t( n & 1 ); }
+
 /* Parse header from wire */
 ContestMessage::Header::Header( const string & str )
-  : sequence_number( get_header_field( 0, str ) ),
-    send_timestamp( get_header_field( 1, str ) ),
-    ack_sequence_number( get_header_field( 2, str ) ),
-    ack_send_timestamp( get_header_field( 3, str ) ),
-    ack_recv_timestamp( get_header_field( 4, str ) ),
-    ack_payload_length( get_header_field( 5, str ) )
+  : Header( str.data(), str.size() )
 {}
 
+ContestMessage::Header::Header( const char * const data, const size_t length )
+  : format( WireFormat::Legacy ),
+    accepts_compact( false ),
+    packet_class( PacketClass::Flow ),
+    sequence_number( -1 ),
+    send_timestamp( -1 ),
+    ack_sequence_number( -1 ),
+    ack_send_timestamp( -1 ),
+    ack_recv_timestamp( -1 ),
+    ack_payload_length( -1 ),
+    ack_ce_count( 0 ),
+    wire_length( 0 )
+{
+  if ( length < 1 ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+
+  const uint8_t first = data[ 0 ];
+
+  if ( not (first & COMPACT_MARKER) ) {
+    const uint64_t field0 = get_header_field( 0, data, length );
+    accepts_compact = (field0 >> 56) & LEGACY_OFFERS_COMPACT;
+    packet_class = PacketClass( (field0 >> 56) & LEGACY_CLASS_MASK );
+    sequence_number = field0 & SEQUENCE_NUMBER_MASK;
+    send_timestamp = get_header_field( 1, data, length );
+    ack_sequence_number = get_header_field( 2, data, length );
+    ack_send_timestamp = get_header_field( 3, data, length );
+    ack_recv_timestamp = get_header_field( 4, data, length );
+    ack_payload_length = get_header_field( 5, data, length );
+    if ( is_ack() ) {
+      ack_ce_count = ack_payload_length >> 32;
+      ack_payload_length &= 0xffffffff;
+    }
+    wire_length = WIRE_SIZE;
+    return;
+  }
+
+  if ( (first & ~COMPACT_MARKER) != COMPACT_VERSION ) {
+    throw runtime_error( "contest message has unsupported header version "
+			 + std::to_string( first & ~COMPACT_MARKER ) );
+  }
+
+  if ( length < 2 ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+
+  const uint8_t flags = data[ 1 ];
+  size_t offset = 2;
+
+  format = WireFormat::Compact;
+  accepts_compact = true;
+  packet_class = PacketClass( flags & COMPACT_CLASS_MASK );
+  sequence_number = get_varint( data, length, offset );
+
+  if ( flags & COMPACT_HAS_SEND_TIMESTAMP ) {
+    send_timestamp = get_varint( data, length, offset );
+  }
+
+  if ( flags & COMPACT_HAS_ACK ) {
+    const uint64_t base = (flags & COMPACT_HAS_SEND_TIMESTAMP) ? send_timestamp : 0;
+    ack_sequence_number = get_varint( data, length, offset );
+    ack_send_timestamp = get_varint( data, length, offset );
+    ack_recv_timestamp = base + unzigzag( get_varint( data, length, offset ) );
+    ack_payload_length = get_varint( data, length, offset );
+  }
+
+  if ( flags & COMPACT_HAS_CE_COUNT ) {
+    ack_ce_count = get_varint( data, length, offset );
+  }
+
+  wire_length = offset;
+}
+
 /* Parse incoming message from wire */
 ContestMessage::ContestMessage( const string & str )
-  : header( str ),
-    payload( str.begin() + sizeof( header ), str.end() )
+  : ContestMessage( str.data(), str.size() )
+{}
+
+ContestMessage::ContestMessage( const char * const data, const size_t length )
+  : header( data, length ),
+    payload( data + header.wire_length, data + length )
 {}
 
 /* Fill in the send_timestamp for an outgoing message */
@@ -51,12 +171,46 @@ string put_header_field( const uint64_t n )
 /* Make wire representation of header */
 string ContestMessage::Header::to_string() const
 {
-  return put_header_field( sequence_number )
-    + put_header_field( send_timestamp )
-    + put_header_field( ack_sequence_number )
-    + put_header_field( ack_send_timestamp )
-    + put_header_field( ack_recv_timestamp )
-    + put_header_field( ack_payload_length );
+  if ( format == WireFormat::Legacy ) {
+    const uint64_t top_byte = uint64_t( packet_class ) | (accepts_compact ? LEGACY_OFFERS_COMPACT : 0);
+    return put_header_field( (top_byte << 56) | (sequence_number & SEQUENCE_NUMBER_MASK) )
+      + put_header_field( send_timestamp )
+      + put_header_field( ack_sequence_number )
+      + put_header_field( ack_send_timestamp )
+      + put_header_field( ack_recv_timestamp )
+      + put_header_field( is_ack() ? (uint64_t( ack_ce_count ) << 32) | (ack_payload_length & 0xffffffff)
+			                   : ack_payload_length );
+  }
+
+  const bool has_send_timestamp = send_timestamp != uint64_t( -1 );
+
+  char out[ MAX_COMPACT_WIRE_SIZE ];
+  out[ 0 ] = char( COMPACT_MARKER | COMPACT_VERSION );
+  out[ 1 ] = char( uint8_t( packet_class ) & COMPACT_CLASS_MASK );
+  size_t length = 2;
+
+  length += put_varint( sequence_number, out + length );
+
+  if ( has_send_timestamp ) {
+    out[ 1 ] |= COMPACT_HAS_SEND_TIMESTAMP;
+    length += put_varint( send_timestamp, out + length );
+  }
+
+  if ( is_ack() ) {
+    const uint64_t base = has_send_timestamp ? send_timestamp : 0;
+    out[ 1 ] |= COMPACT_HAS_ACK;
+    length += put_varint( ack_sequence_number, out + length );
+    length += put_varint( ack_send_timestamp, out + length );
+    length += put_varint( zigzag( int64_t( ack_recv_timestamp - base ) ), out + length );
+    length += put_varint( ack_payload_length, out + length );
+  }
+
+  if ( ack_ce_count ) {
+    out[ 1 ] |= COMPACT_HAS_CE_COUNT;
+    length += put_varint( ack_ce_count, out + length );
+  }
+
+  return string( out, length );
 }
 
 /* Make wire representation of message */
@@ -93,16 +247,38 @@ ContestMessage::ContestMessage( const uint64_t s_sequence_number,
 
 /* Header for new message */
 ContestMessage::Header::Header( const uint64_t s_sequence_number )
-  : sequence_number( s_sequence_number ),
+  : format( WireFormat::Legacy ),
+    accepts_compact( false ),
+    packet_class( PacketClass::Flow ),
+    sequence_number( s_sequence_number ),
     send_timestamp( -1 ),
     ack_sequence_number( -1 ),
     ack_send_timestamp( -1 ),
     ack_recv_timestamp( -1 ),
-    ack_payload_length( -1 )
+    ack_payload_length( -1 ),
+    ack_ce_count( 0 ),
+    wire_length( 0 )
 {}
 
 /* Is this message an ack? */
+bool ContestMessage::Header::is_ack() const
+{
+  return ack_sequence_number != uint64_t( -1 );
+}
+
 bool ContestMessage::is_ack() const
 {
-  return header.ack_sequence_number != uint64_t( -1 );
+  return header.is_ack();
+}
+
+/* Class of a datagram from its first byte, without parsing it */
+ContestMessage::PacketClass ContestMessage::peek_class( const char * const data, const size_t length )
+{
+  if ( length < 2 ) {
+    throw runtime_error( "contest message too small to contain header" );
+  }
+
+  const uint8_t first = data[ 0 ];
+  return PacketClass( (first & COMPACT_MARKER) ? (data[ 1 ] & COMPACT_CLASS_MASK)
+				               : (first & LEGACY_CLASS_MASK) );
 }
@@ -6,7 +6,26 @@
 
 struct ContestMessage
 {
+  /* what a datagram is for (parity datagrams, and the receiver's
+     reports on them, carry forward error correction; see fec.hh) */
+  enum class PacketClass : uint8_t { Flow = 0, CrossTraffic = 1, Parity = 2 };
+
+  /* Legacy: six 64-bit big-endian fields, with the packet class (and an
+     offer to switch to the compact format) in the top byte of the first,
+     so sequence numbers are limited to 56 bits. An ack's CE count rides
+     in the top half of its payload length field.
+
+     Compact (version 1): a version byte with the high bit set, a flags
+     byte, then varints: the sequence number, the send timestamp (if
+     set), the ack fields (if an ack), with the ack's receive timestamp
+     coded as a delta from its send timestamp, and the CE count (if
+     nonzero). */
+  enum class WireFormat : uint8_t { Legacy, Compact };
+
   struct Header {
+    WireFormat format;
+    bool accepts_compact; /* sender offers to switch to the compact format */
+    PacketClass packet_class;
     uint64_t sequence_number;
     uint64_t send_timestamp;
 
@@ -14,15 +33,27 @@ struct ContestMessage
     uint64_t ack_send_timestamp;
     uint64_t ack_recv_timestamp;
     uint64_t ack_payload_length;
+    uint32_t ack_ce_count; /* flow datagrams the receiver has seen marked CE (wraps) */
+
+    /* bytes on the wire in the legacy format, and at most in the compact one */
+    static const size_t WIRE_SIZE = 6 * sizeof( uint64_t );
+    static const size_t MAX_COMPACT_WIRE_SIZE = 2 + 6 * 10 + 5;
+
+    /* bytes the header took on the wire (when parsed) */
+    size_t wire_length;
 
     /* Header for new message */
     Header( const uint64_t s_sequence_number );
 
     /* Parse header from wire */
     Header( const std::string & str );
+    Header( const char * const data, const size_t length );
 
-    /* Make wire representation of header */
+    /* Make wire representation of header (in its format) */
     std::string to_string() const;
+
+    /* Is this message an ack? */
+    bool is_ack() const;
   } header;
 
   std::string payload;
@@ -33,6 +64,7 @@ struct ContestMessage
 
   /* Parse incoming datagram from wire */
   ContestMessage( const std::string & str );
+  ContestMessage( const char * const data, const size_t length );
 
   /* Fill in the send_timestamp for an outgoing datagram */
   void set_send_timestamp();
@@ -46,6 +78,9 @@ struct ContestMessage
 
   /* Is this message an ack? */
   bool is_ack() const;
+
+  /* Class of a datagram from its first byte, without parsing it */
+  static PacketClass peek_class( const char * const data, const size_t length );
 };
 
 #endif /* CONTEST_MESSAGE_HH */
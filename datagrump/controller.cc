@@ -1,7 +1,9 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <cassert>
 #include <math.h>
+#include <type_traits>
 
 #include "controller.hh"
 #include "timestamp.hh"
@@ -12,133 +14,328 @@ using namespace std;
 #define TICK_SIZE (20)
 #define PACKET_SIZE_BYTES (1424)
 
+/* x^y for x >= 1 and y >= 0 in straight-line arithmetic (no libm call):
+   log2 from the exponent bits plus a polynomial on the mantissa, exp2 from
+   a polynomial on the fraction. Relative error is about 1e-4, which is
+   plenty for a window increment. */
+static inline double approx_pow( const double x, const double y )
+{
+  /* split x into 2^exponent * mantissa, with mantissa in [1, 2) */
+  uint64_t bits;
+  memcpy( &bits, &x, sizeof( bits ) );
+  const int64_t exponent = int64_t( bits >> 52 ) - 1023;
+  bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+  double m;
+  memcpy( &m, &bits, sizeof( m ) );
+  m -= 1;
+
+  const double log2_x = exponent + m * (1.4386380259 + m * (-0.6777432666
+                                      + m * (0.3218797069 + m * -0.0828606982)));
+
+  /* 2^t = 2^whole * 2^fraction, t >= 0 so truncation is floor */
+  const double t = y * log2_x;
+  const int64_t whole = int64_t( t );
+  const double f = t - whole;
+  const double exp2_f = 1 + f * (0.6955640749 + f * (0.2261692876 + f * 0.0781411621));
+
+  memcpy( &bits, &exp2_f, sizeof( bits ) );
+  bits += uint64_t( whole ) << 52;
+  double ret;
+  memcpy( &ret, &bits, sizeof( ret ) );
+  return ret;
+}
+
 /* Default constructor */
-Controller::Controller( const bool debug, const bool use_ctcp )
-  : debug_( debug ),
-    use_ctcp_( use_ctcp ),
-    cwnd(1),
-    dwnd(0),
-    cwnd_(1.),
-    dwnd_(0.)
+template <class Algorithm, bool Debug>
+Controller<Algorithm, Debug>::Controller()
 {
   cerr << "cwnd: " << cwnd << " dwnd: " << dwnd << endl;
   cerr << "cwnd_: " << cwnd_ << " dwnd_: " << dwnd_ << endl;
 }
 
 /* Get current window size, in datagrams */
-unsigned int Controller::window_size()
+template <class Algorithm, bool Debug>
+unsigned int Controller<Algorithm, Debug>::window_size()
 {
   /* Default: fixed window size of 100 outstanding datagrams */
-  if ( debug_ ) {
+  if ( Debug ) {
     cerr << "At time " << timestamp_ms()
 	 << " window size is " << cwnd + dwnd << endl;
+    assert (cwnd + dwnd >= 0);
   }
-  assert (cwnd + dwnd >= 0);
   return cwnd + dwnd;
 }
 
-
-void Controller::enter_slow_start() {
-  /* revert to slow start */ 
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::enter_slow_start() {
+  /* revert to slow start */
   cwnd_ = cwnd = 1;
   dwnd_ = dwnd = 0;
   slow_start = true;
+
+  round_end = last_sent;
+  round_min_rtt = last_round_min_rtt = INFINITY;
+  round_samples = 0;
+  train_broken = true;
+  css_rounds_left = 0;
+}
+
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::seed( const double window, const double rtt_estimate,
+                                         const double loss_window )
+{
+  cwnd_ = max(1.0, min(window, Algorithm::max_seeded_window));
+  cwnd = int(cwnd_);
+  rtt = rtt_estimate;
+  if (loss_window > cwnd_) {
+    ssthresh = loss_window;
+  }
+
+  if (Debug)
+    cerr << "seeded cwnd " << cwnd_ << " rtt " << rtt << " ssthresh " << ssthresh << endl;
+}
+
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::hystart_ack( const uint64_t sequence_number_acked,
+                                                const uint64_t timestamp_ack_received )
+{
+  /* a new round starts once the last one's window is acked */
+  if (sequence_number_acked >= round_end) {
+    last_round_min_rtt = round_min_rtt;
+    round_min_rtt = INFINITY;
+    round_samples = 0;
+    round_end = last_sent;
+    train_start = last_ack_time = timestamp_ack_received;
+    train_broken = false;
+
+    if (css_rounds_left && --css_rounds_left == 0) {
+      slow_start = false;
+      if (Debug)
+        cerr << "slow start over after conservative rounds at cwnd " << cwnd_ << endl;
+      return;
+    }
+  }
+
+  /* ack train: acks arriving back to back for half the minimum rtt
+     mean the window already fills the path */
+  if (timestamp_ack_received - last_ack_time > Algorithm::hystart_ack_spacing) {
+    train_broken = true;
+  }
+  last_ack_time = timestamp_ack_received;
+  if (!train_broken && !css_rounds_left
+      && timestamp_ack_received - train_start >= base_rtt / 2) {
+    slow_start = false;
+    if (Debug)
+      cerr << "slow start exit on ack train at cwnd " << cwnd_ << endl;
+    return;
+  }
+
+  /* delay increase: the round's minimum rtt rose by an eighth of the
+     last round's (within bounds), so a queue is building */
+  if (round_samples >= Algorithm::hystart_samples) {
+    return;
+  }
+  round_min_rtt = min(round_min_rtt, rtt_sample);
+  if (++round_samples < Algorithm::hystart_samples || isinf(last_round_min_rtt)) {
+    return;
+  }
+
+  double threshold = max(Algorithm::hystart_min_delay_increase,
+                         min(last_round_min_rtt / 8, Algorithm::hystart_max_delay_increase));
+  if (!css_rounds_left && round_min_rtt >= last_round_min_rtt + threshold) {
+    css_rounds_left = Algorithm::css_rounds;
+    css_baseline_rtt = last_round_min_rtt;
+    if (Debug)
+      cerr << "slow start slowing on delay increase at cwnd " << cwnd_ << endl;
+  } else if (css_rounds_left && round_min_rtt < css_baseline_rtt) {
+    /* the rise was spurious: back to full-speed slow start */
+    css_rounds_left = 0;
+  }
 }
 
 /* A datagram was sent */
-void Controller::datagram_was_sent( const uint64_t sequence_number,
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::datagram_was_sent( const uint64_t sequence_number,
 				    /* of the sent datagram */
 				    const uint64_t send_timestamp,
                                     /* in milliseconds */
 				    const bool after_timeout
 				    /* datagram was sent because of a timeout */ )
 {
+  last_sent = max(last_sent, sequence_number);
+
   /* Default: take no action */
   if (after_timeout) {
     enter_slow_start();
   }
 
-  if ( debug_ ) {
+  if ( Debug ) {
     cerr << "At time " << send_timestamp
 	 << " sent datagram " << sequence_number << " (timeout = " << after_timeout << ")\n";
   }
 
 }
 
-void Controller::update_rtt(const uint64_t timestamp_ack_received, 
-                               const uint64_t send_timestamp_acked) {
-
-  double cur_rtt = double(timestamp_ack_received - send_timestamp_acked);
-  rtt = rtt_smooth * cur_rtt + (1 - rtt_smooth) * rtt;
-  if (base_rtt > cur_rtt)
-    base_rtt = cur_rtt;
-  if (debug_)
-    cerr << "rtt: " << rtt << endl; 
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::update_rtt(const double cur_rtt) {
+  rtt = Algorithm::rtt_smooth * cur_rtt + (1 - Algorithm::rtt_smooth) * rtt;
+  base_rtt = min(base_rtt, cur_rtt);
+  rtt_sample = cur_rtt;
+  if (Debug)
+    cerr << "rtt: " << rtt << endl;
 }
 
-void Controller::update_dwnd(double win, double diff, bool loss) {
+inline double CTCP::update_dwnd(double dwnd, double win, double cwnd, double diff, bool loss) {
   if (loss) {
-    dwnd_ = win * (1 - beta) - float(cwnd) / 2; 
-    if (dwnd_ < 0) dwnd_ = 0; 
+    dwnd = win * (1 - beta) - float(cwnd) / 2;
   } else if (diff < gamma) {
-    double update = alpha * pow(win, k) - 1;
-    if (update < 0) update = 0;
-    dwnd_ += update;
+    dwnd += max(alpha * approx_pow(max(win, 1.0), k) - 1, 0.0);
   } else {
-    dwnd_ -= zeta * diff; 
-    if (dwnd_ < 0) dwnd_ = 0;
+    dwnd -= zeta * diff;
   }
-  assert(dwnd_ >= 0);
-
+  return max(dwnd, 0.0);
 }
 
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::update_dwnd(double win, double diff, bool loss) {
+  dwnd_ = Algorithm::update_dwnd(dwnd_, win, cwnd, diff, loss);
+}
 
-bool is_router_buffer_full(const uint64_t send_timestamp_acked, const uint64_t timestamp_ack_received)
+template <class Algorithm>
+static bool is_router_buffer_full(const double cur_rtt)
 {
-  // return timestamp_ack_received > send_timestamp_acked + 330; //for 72 Mbps
-  return timestamp_ack_received > send_timestamp_acked + 155; //for 360 Mbps
-  // return timestamp_ack_received > send_timestamp_acked + 130; //for 360 Mbps
-  /* heuristic: 
+  // return cur_rtt > 330; //for 72 Mbps
+  return cur_rtt > Algorithm::buffer_full_delay; //for 360 Mbps
+  // return cur_rtt > 130; //for 360 Mbps
+  /* heuristic:
      assume a 1500 packet buffer, 12,000 bits per MTU packet, link rate of 72Mbps, rtprop of 80ms
      then the buffer will be full when the packet delay is:
      1500 pkt * 12000 b/pkt / (72 Mbps) + 80 ms = 330 ms. */
 }
 
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::ecn_ack( const uint64_t sequence_number_acked,
+                                            const unsigned int ce_marks )
+{
+  /* nothing to track until the path marks (alpha stays 1, so the
+     first cut halves the window) */
+  if (!ce_marks && !ce_marks_) {
+    return;
+  }
+
+  ecn_acked++;
+  ecn_marked += ce_marks;
+  ce_marks_ += ce_marks;
+
+  /* the window is over: fold its marked fraction into alpha (at DCTCP's
+     resolution of 1/1024, which also keeps it out of subnormals) */
+  if (sequence_number_acked >= ecn_round_end) {
+    ecn_alpha += Algorithm::ecn_gain * (double(ecn_marked) / ecn_acked - ecn_alpha);
+    if (ecn_alpha < 1.0 / 1024) {
+      ecn_alpha = 0;
+    }
+    ecn_acked = ecn_marked = 0;
+    ecn_round_end = last_sent;
+  }
+
+  /* one cut per window, in proportion to how much of it is marked */
+  if (ce_marks && sequence_number_acked >= ecn_cut_end) {
+    const double factor = 1 - ecn_alpha / 2;
+    cwnd_ = max(cwnd_ * factor, 1.0);
+    dwnd_ *= factor;
+    cwnd = int(cwnd_);
+    dwnd = int(dwnd_);
+    slow_start = false;
+    css_rounds_left = 0;
+    ecn_cut_end = last_sent;
+    ecn_cuts_++;
+    if (Debug)
+      cerr << "ECN cut by " << factor << " (alpha " << ecn_alpha << ")" << endl;
+  }
+}
+
+/* queue estimate above which a gap is congestion (for controllers
+   that tell random loss from congestive loss) */
+template <class Algorithm>
+static constexpr typename enable_if<Algorithm::differentiates_loss, double>::type congestive_diff()
+{
+  return Algorithm::congestive_diff;
+}
+
+template <class Algorithm>
+static constexpr typename enable_if<!Algorithm::differentiates_loss, double>::type congestive_diff()
+{
+  return 0;
+}
+
 /* An ack was received */
-void Controller::ack_received( const uint64_t sequence_number_acked,
+template <class Algorithm, bool Debug>
+void Controller<Algorithm, Debug>::ack_received( const uint64_t sequence_number_acked,
 			       /* what sequence number was acknowledged */
 			       const uint64_t send_timestamp_acked,
 			       /* when the acknowledged datagram was sent (sender's clock) */
 			       const uint64_t recv_timestamp_acked,
 			       /* when the acknowledged datagram was received (receiver's clock)*/
-			       const uint64_t timestamp_ack_received )
+			       const uint64_t timestamp_ack_received,
                                /* when the ack was received (by sender) */
+			       const unsigned int ce_marks )
+                               /* datagrams newly reported marked CE */
 {
 
+  double cur_rtt = double(timestamp_ack_received - send_timestamp_acked);
+  if (Algorithm::uses_one_way_delay) {
+    /* the path's minimum rtt, plus only the queue on the way out */
+    forward_delay_ = owd_.sample(send_timestamp_acked, recv_timestamp_acked);
+    cur_rtt = min(base_rtt, cur_rtt) + forward_delay_;
+  }
+
   bool stochastic_loss = next_ack_expected_ != sequence_number_acked;
-  bool packet_loss = stochastic_loss || is_router_buffer_full(send_timestamp_acked, timestamp_ack_received);
+  bool buffer_full = is_router_buffer_full<Algorithm>(cur_rtt);
+
+  /* a gap with no queue behind it is random loss, not congestion */
+  if (Algorithm::differentiates_loss && stochastic_loss && !buffer_full && rtt > 0) {
+    double diff = (cwnd_ + dwnd_) * (1 - base_rtt / rtt);
+    if (diff < congestive_diff<Algorithm>()) {
+      stochastic_loss = false;
+      random_losses_++;
+      if (Debug)
+        cerr << "random loss (diff " << diff << ")" << endl;
+    }
+  }
+
+  bool packet_loss = stochastic_loss || buffer_full;
 
   bool loss = false;
-  if (packet_loss && timestamp_ack_received > loss_timestamp + LOSS_TIMEOUT) {
+  if (packet_loss && timestamp_ack_received > loss_timestamp + Algorithm::loss_timeout) {
     loss = true;
     loss_timestamp = timestamp_ack_received;
+    loss_events_++;
+    loss_window_ = cwnd_ + dwnd_;
+    ecn_cut_end = last_sent; /* the loss is this window's cut */
   }
 
   next_ack_expected_ = max(next_ack_expected_, sequence_number_acked + 1);
 
-  update_rtt(timestamp_ack_received, send_timestamp_acked);
-  if (debug_ && loss)
+  update_rtt(cur_rtt);
+  if (Debug && loss)
     cerr << "loss!" << endl;
 
   if (slow_start) {
     if (loss) {
-      cwnd = 1;
+      /* the window overshot: fall back to half and leave slow start,
+         rather than starting over from one datagram */
+      cwnd_ = max(cwnd_ / 2, 1.0);
+      slow_start = false;
+      css_rounds_left = 0;
     } else {
-      cwnd += 1;
-      if (rtt > SLOWSTART_TIMEOUT)
-        slow_start = false; 
+      cwnd_ += css_rounds_left ? 1.0 / Algorithm::css_growth_divisor : 1.0;
+      if (cwnd_ >= ssthresh) {
+        slow_start = false;
+      } else {
+        hystart_ack(sequence_number_acked, timestamp_ack_received);
+      }
     }
-    cwnd_ = cwnd;
+    cwnd = int(cwnd_);
     dwnd_ = dwnd;
   } else {
     /* update cwnd according to normal tcp: */
@@ -149,20 +346,22 @@ void Controller::ack_received( const uint64_t sequence_number_acked,
 
     } else
       cwnd_ += 1.0/(cwnd_ + dwnd_);
-    
-    if (use_ctcp_) {
+
+    if (Algorithm::uses_delay_window) {
+      /* diff = (expected - actual) * base_rtt,
+         with expected = win / base_rtt and actual = win / rtt */
       double win = cwnd_ + dwnd_;
-      double expected = win / base_rtt;
-      double actual =  win / rtt;
-      double diff = (expected - actual) * base_rtt;
+      double diff = win * (1 - base_rtt / rtt);
       update_dwnd(win, diff, loss);
     }
 
     cwnd = int(cwnd_);
     dwnd = int(dwnd_);
-  } 
+  }
+
+  ecn_ack(sequence_number_acked, ce_marks);
 
-  if ( debug_ ) {
+  if ( Debug ) {
     cerr << "At time " << timestamp_ack_received
 	 << " received ack for datagram " << sequence_number_acked
 	 << " (send @ time " << send_timestamp_acked
@@ -174,7 +373,24 @@ void Controller::ack_received( const uint64_t sequence_number_acked,
 
 /* How long to wait (in milliseconds) if there are no acks
    before sending one more datagram */
-unsigned int Controller::timeout_ms()
+template <class Algorithm, bool Debug>
+unsigned int Controller<Algorithm, Debug>::timeout_ms()
 {
   return 400; /* timeout of half a second */
 }
+
+/* names accepted by select_controller() */
+bool is_controller_name( const string & name )
+{
+  return name == "ctcp" or name == "tcp" or name == "ctcp-ld" or name == "ctcp-owd";
+}
+
+/* the instantiations select_controller() can pick */
+template class Controller<Reno, false>;
+template class Controller<Reno, true>;
+template class Controller<CTCP, false>;
+template class Controller<CTCP, true>;
+template class Controller<CTCPLossDiff, false>;
+template class Controller<CTCPLossDiff, true>;
+template class Controller<CTCPOneWay, false>;
+template class Controller<CTCPOneWay, true>;
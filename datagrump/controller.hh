@@ -2,14 +2,100 @@
 #define CONTROLLER_HH
 
 #include <cstdint>
+#include <string>
 #include <math.h>
 
+#include "one_way_delay.hh"
+
+/* Parameters shared by every congestion-control algorithm */
+struct ControllerDefaults
+{
+  static constexpr double rtt_smooth = 0.05; /* ewma smoothing factor. */
+
+  /* HyStart slow-start exit, relative to the minimum rtt: each round (a
+     window of acks), the smallest of its first samples is compared with
+     the last round's, and a run of closely spaced acks is timed */
+  static constexpr unsigned int hystart_samples = 8; /* rtt samples per round */
+  static constexpr double hystart_min_delay_increase = 4; /* ms */
+  static constexpr double hystart_max_delay_increase = 16; /* ms */
+  static constexpr uint64_t hystart_ack_spacing = 2; /* most ms between acks in a train */
+
+  /* after a delay increase, slow start continues this many rounds at a
+     fraction of its growth before congestion avoidance takes over */
+  static constexpr unsigned int css_rounds = 5;
+  static constexpr double css_growth_divisor = 4;
+
+  /* most datagrams a flow seeded from cached path metrics may start with */
+  static constexpr double max_seeded_window = 64;
+  static constexpr uint64_t loss_timeout = 80; /* at most one loss event per this long (ms) */
+  static constexpr uint64_t buffer_full_delay = 155; /* rtt (ms) that signals a full router buffer */
+  static constexpr bool differentiates_loss = false; /* every gap in the acks is congestion */
+  static constexpr bool uses_one_way_delay = false; /* delay is measured over the round trip */
+
+  /* ECN, as in DCTCP: alpha, the smoothed fraction of datagrams marked CE
+     per window, moves by this gain each window, and a window with marks
+     cuts the window by alpha / 2 (half, when every datagram is marked) */
+  static constexpr double ecn_gain = 1.0 / 16;
+};
+
+/* Standard TCP (Reno) window: no delay-based component */
+struct Reno : ControllerDefaults
+{
+  static constexpr bool uses_delay_window = false;
+
+  static double update_dwnd( const double, const double, const double, const double, const bool )
+  {
+    return 0;
+  }
+};
+
+/* Compound TCP: Reno plus a delay-based window */
+struct CTCP : ControllerDefaults
+{
+  static constexpr bool uses_delay_window = true;
+
+  static constexpr double alpha = 1.0;
+  static constexpr double beta = 0.3;
+  static constexpr double k = 0.1;
+  static constexpr double gamma = 30;
+  static constexpr double zeta = 0.02;
+
+  /* new delay window, given the old one, the total and loss-based windows,
+     the estimated number of queued datagrams, and whether there was a loss */
+  static double update_dwnd( const double dwnd, const double win, const double cwnd,
+			     const double diff, const bool loss );
+};
+
+/* Compound TCP that keeps its window through random loss. CTCP holds
+   about gamma datagrams in the bottleneck queue, so a gap in the acks
+   while diff (the estimated queue) is well below that cannot be the
+   queue overflowing: the path dropped the datagram at random. Only gaps
+   with a standing queue, and a full router buffer, cut the window. */
+struct CTCPLossDiff : CTCP
+{
+  static constexpr bool differentiates_loss = true;
+  static constexpr double congestive_diff = 2 * gamma;
+};
+
+/* Compound TCP that measures only the forward path. Our acks share
+   links with cross traffic, and queueing on their way back inflates the
+   rtt, shrinking the delay window and signalling a full buffer that is
+   not ours. This mode takes the delay of each ack as the minimum rtt
+   plus the forward queueing delay, from the receiver's timestamps (see
+   OneWayDelay), so only the queue the flow itself feeds moves it. */
+struct CTCPOneWay : CTCP
+{
+  static constexpr bool uses_one_way_delay = true;
+};
+
+/* Congestion controller. The algorithm and its parameters, and whether
+   to trace every event to stderr, are fixed at compile time so the
+   per-ack path carries no mode checks; select_controller() picks the
+   instantiation at runtime. */
+template <class Algorithm, bool Debug = false>
 class Controller
 {
 private:
-  bool debug_; /* Enables debugging output */
-  bool use_ctcp_; /* use CTCP flag. */
-
   /* Add member variables here */
   bool slow_start = true;
   int cwnd = 1;
@@ -18,24 +104,42 @@ private:
   double cwnd_ = 1;
   double dwnd_ = 0;
 
-  /* CTCP params: */
-  double alpha = 1.0;
-  double beta = 0.3; /* not used, currently. */
-  float k = 0.1;
-  int gamma = 30;
-  double zeta = 0.02;
-
   /* RTT params */
   double rtt = 0;
-  double base_rtt = INFINITY; 
-
-  double rtt_smooth = 0.05; /* ewma smoothing factor. */
-
-  uint64_t next_ack_expected_ = 1; /* next ack we're expecting to see. */
+  double base_rtt = INFINITY;
+  double rtt_sample = 0; /* from the latest ack */
+
+  /* forward queueing delay (for controllers that use one-way delay) */
+  OneWayDelay owd_ {};
+  double forward_delay_ = 0;
+
+  /* HyStart state: the current round ends when last_sent as of its
+     start is acked */
+  uint64_t last_sent = 0;
+  uint64_t round_end = 0;
+  double round_min_rtt = INFINITY;
+  double last_round_min_rtt = INFINITY;
+  unsigned int round_samples = 0;
+  uint64_t train_start = 0, last_ack_time = 0;
+  bool train_broken = false;
+  unsigned int css_rounds_left = 0; /* nonzero in conservative slow start */
+  double css_baseline_rtt = INFINITY;
+
+  uint64_t next_ack_expected_ = 0; /* next ack we're expecting to see (the sender starts at 0). */
 
-  double SLOWSTART_TIMEOUT = 125;
-  uint64_t LOSS_TIMEOUT = 80;
   uint64_t loss_timestamp = 0;
+  uint64_t loss_events_ = 0; /* number of window reductions due to loss */
+  uint64_t random_losses_ = 0; /* gaps taken for random loss (and ignored) */
+  double loss_window_ = 0; /* total window at the last loss event */
+  double ssthresh = INFINITY; /* slow start ends at this window (seeded from cached metrics) */
+
+  /* ECN: marks and acks over the window ending at ecn_round_end, and
+     no further cut until ecn_cut_end is acked */
+  double ecn_alpha = 1;
+  uint64_t ecn_acked = 0, ecn_marked = 0;
+  uint64_t ecn_round_end = 0, ecn_cut_end = 0;
+  uint64_t ce_marks_ = 0; /* marks echoed by the receiver */
+  uint64_t ecn_cuts_ = 0; /* window reductions due to them */
 
 public:
   /* Public interface for the congestion controller */
@@ -43,38 +147,88 @@ public:
      the call site as well (in sender.cc) */
 
   /* Default constructor */
-  Controller( const bool debug, const bool use_ctcp );
+  Controller();
 
   /* Get current window size, in datagrams */
   unsigned int window_size();
 
   void enter_slow_start();
 
+  /* start from what an earlier flow learned about the path: a window
+     (bounded by max_seeded_window), the rtt, and the window at which
+     it last saw loss, where slow start now ends */
+  void seed( const double window, const double rtt_estimate, const double loss_window );
+
+  /* HyStart: track the round, and leave (or slow down) slow start
+     on a long ack train or a rise in delay */
+  void hystart_ack( const uint64_t sequence_number_acked,
+                    const uint64_t timestamp_ack_received );
+
   /* A datagram was sent */
   void datagram_was_sent( const uint64_t sequence_number,
 			  const uint64_t send_timestamp,
 			  const bool after_timeout );
 
-  void update_rtt(const uint64_t timestamp_ack_received, 
-                               const uint64_t send_timestamp_acked);
+  /* take a new rtt sample, in ms */
+  void update_rtt(const double cur_rtt);
 
   void update_dwnd(double win, double diff, bool loss);
 
-  /* An ack was received */
+  /* An ack was received (reporting ce_marks more datagrams marked
+     congestion experienced since the last) */
   void ack_received( const uint64_t sequence_number_acked,
 		     const uint64_t send_timestamp_acked,
 		     const uint64_t recv_timestamp_acked,
-		     const uint64_t timestamp_ack_received );
+		     const uint64_t timestamp_ack_received,
+		     const unsigned int ce_marks = 0 );
+
+  /* DCTCP: update alpha each window, and cut the window on marks */
+  void ecn_ack( const uint64_t sequence_number_acked, const unsigned int ce_marks );
 
   /* How long to wait (in milliseconds) if there are no acks
      before sending one more datagram */
   unsigned int timeout_ms();
 
-  void do_rtt_update(const uint64_t timestamp_ack_received, 
-                               const uint64_t send_timestamp_acked);
-  void do_ewma_probe(const uint64_t tick_time);
-  void do_ewma_steady(const uint64_t tick_time);
-
+  /* accessors for live stats */
+  int congestion_window() const { return cwnd; }
+  int delay_window() const { return dwnd; }
+  double smoothed_rtt() const { return rtt; }
+  double min_rtt() const { return base_rtt; }
+  uint64_t loss_events() const { return loss_events_; }
+  uint64_t random_losses() const { return random_losses_; }
+  double loss_window() const { return loss_window_; }
+  double forward_delay() const { return forward_delay_; }
+  double clock_skew_ppm() const { return owd_.skew_ppm(); }
+  uint64_t ce_marks() const { return ce_marks_; }
+  uint64_t ecn_cuts() const { return ecn_cuts_; }
+  double ecn_fraction() const { return ce_marks_ ? ecn_alpha : 0; }
 };
 
+/* names accepted by select_controller() */
+bool is_controller_name( const std::string & name );
+
+/* Pick the controller instantiation at runtime: returns
+   client.template run<ControllerType>() for the named algorithm. */
+template <class Client>
+int select_controller( const std::string & name, const bool debug, Client & client )
+{
+  if ( name == "tcp" ) {
+    return debug ? client.template run<Controller<Reno, true>>()
+                 : client.template run<Controller<Reno, false>>();
+  }
+
+  if ( name == "ctcp-owd" ) {
+    return debug ? client.template run<Controller<CTCPOneWay, true>>()
+                 : client.template run<Controller<CTCPOneWay, false>>();
+  }
+
+  if ( name == "ctcp-ld" ) {
+    return debug ? client.template run<Controller<CTCPLossDiff, true>>()
+                 : client.template run<Controller<CTCPLossDiff, false>>();
+  }
+
+  return debug ? client.template run<Controller<CTCP, true>>()
+               : client.template run<Controller<CTCP, false>>();
+}
+
 #endif
@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <endian.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define GF256_X86_KERNELS
+#endif
+
+#include "fec.hh"
+
+using namespace std;
+
+/* GF(256) with the polynomial x^8 + x^4 + x^3 + x^2 + 1, by log and exp
+   tables (exp is doubled so a sum of two logs needs no reduction) */
+namespace {
+  struct GF256Tables
+  {
+    uint8_t exp_[ 512 ];
+    uint8_t log_[ 256 ];
+
+    GF256Tables()
+      : exp_(), log_()
+    {
+      unsigned int x = 1;
+      for ( unsigned int i = 0; i < 255; i++ ) {
+	exp_[ i ] = exp_[ i + 255 ] = x;
+	log_[ x ] = i;
+	x <<= 1;
+	if ( x & 0x100 ) {
+	  x ^= 0x11d;
+	}
+      }
+    }
+  };
+
+  const GF256Tables gf;
+}
+
+static uint8_t gf256_mul( const uint8_t a, const uint8_t b )
+{
+  return (a and b) ? gf.exp_[ gf.log_[ a ] + gf.log_[ b ] ] : 0;
+}
+
+static uint8_t gf256_inverse( const uint8_t a )
+{
+  if ( a == 0 ) {
+    throw runtime_error( "GF(256) inverse of zero" );
+  }
+  return gf.exp_[ 255 - gf.log_[ a ] ];
+}
+
+void gf256_mul_add_scalar( uint8_t * const dst, const uint8_t * const src,
+			   const uint8_t coefficient, const size_t length )
+{
+  if ( coefficient == 0 ) {
+    return;
+  }
+
+  if ( coefficient == 1 ) {
+    for ( size_t i = 0; i < length; i++ ) {
+      dst[ i ] ^= src[ i ];
+    }
+    return;
+  }
+
+  const unsigned int log_coefficient = gf.log_[ coefficient ];
+  for ( size_t i = 0; i < length; i++ ) {
+    if ( src[ i ] ) {
+      dst[ i ] ^= gf.exp_[ log_coefficient + gf.log_[ src[ i ] ] ];
+    }
+  }
+}
+
+#ifdef GF256_X86_KERNELS
+
+/* products of the coefficient with every low nibble and every high
+   nibble; a byte's product is the sum of its two nibbles' products,
+   so a 16-entry byte shuffle multiplies a whole vector at once */
+static void nibble_tables( const uint8_t coefficient, uint8_t low[ 16 ], uint8_t high[ 16 ] )
+{
+  for ( unsigned int n = 0; n < 16; n++ ) {
+    low[ n ] = gf256_mul( coefficient, n );
+    high[ n ] = gf256_mul( coefficient, n << 4 );
+  }
+}
+
+__attribute__(( target( "ssse3" ) ))
+static void gf256_mul_add_ssse3( uint8_t * const dst, const uint8_t * const src,
+				 const uint8_t coefficient, const size_t length )
+{
+  if ( coefficient <= 1 ) {
+    gf256_mul_add_scalar( dst, src, coefficient, length );
+    return;
+  }
+
+  uint8_t low[ 16 ], high[ 16 ];
+  nibble_tables( coefficient, low, high );
+  const __m128i low_table = _mm_loadu_si128( reinterpret_cast<const __m128i *>( low ) );
+  const __m128i high_table = _mm_loadu_si128( reinterpret_cast<const __m128i *>( high ) );
+  const __m128i mask = _mm_set1_epi8( 0x0f );
+
+  size_t i = 0;
+  for ( ; i + 16 <= length; i += 16 ) {
+    const __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + i ) );
+    const __m128i product = _mm_xor_si128( _mm_shuffle_epi8( low_table, _mm_and_si128( x, mask ) ),
+					   _mm_shuffle_epi8( high_table, _mm_and_si128( _mm_srli_epi64( x, 4 ), mask ) ) );
+    __m128i * const out = reinterpret_cast<__m128i *>( dst + i );
+    _mm_storeu_si128( out, _mm_xor_si128( _mm_loadu_si128( out ), product ) );
+  }
+
+  gf256_mul_add_scalar( dst + i, src + i, coefficient, length - i );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void gf256_mul_add_avx2( uint8_t * const dst, const uint8_t * const src,
+				const uint8_t coefficient, const size_t length )
+{
+  if ( coefficient <= 1 ) {
+    gf256_mul_add_scalar( dst, src, coefficient, length );
+    return;
+  }
+
+  uint8_t low[ 16 ], high[ 16 ];
+  nibble_tables( coefficient, low, high );
+  const __m256i low_table = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( low ) ) );
+  const __m256i high_table = _mm256_broadcastsi128_si256( _mm_loadu_si128( reinterpret_cast<const __m128i *>( high ) ) );
+  const __m256i mask = _mm256_set1_epi8( 0x0f );
+
+  size_t i = 0;
+  for ( ; i + 32 <= length; i += 32 ) {
+    const __m256i x = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( src + i ) );
+    const __m256i product = _mm256_xor_si256( _mm256_shuffle_epi8( low_table, _mm256_and_si256( x, mask ) ),
+					      _mm256_shuffle_epi8( high_table, _mm256_and_si256( _mm256_srli_epi64( x, 4 ), mask ) ) );
+    __m256i * const out = reinterpret_cast<__m256i *>( dst + i );
+    _mm256_storeu_si256( out, _mm256_xor_si256( _mm256_loadu_si256( out ), product ) );
+  }
+
+  gf256_mul_add_scalar( dst + i, src + i, coefficient, length - i );
+}
+
+#endif /* GF256_X86_KERNELS */
+
+namespace {
+  typedef void (*MulAddKernel)( uint8_t * const, const uint8_t * const, const uint8_t, const size_t );
+
+  struct KernelChoice
+  {
+    MulAddKernel kernel;
+    const char * name;
+  };
+
+  KernelChoice choose_kernel()
+  {
+#ifdef GF256_X86_KERNELS
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+      return { gf256_mul_add_avx2, "avx2" };
+    }
+    if ( __builtin_cpu_supports( "ssse3" ) ) {
+      return { gf256_mul_add_ssse3, "ssse3" };
+    }
+#endif
+    return { gf256_mul_add_scalar, "scalar" };
+  }
+
+  const KernelChoice kernel_choice = choose_kernel();
+}
+
+void gf256_mul_add( uint8_t * const dst, const uint8_t * const src,
+		    const uint8_t coefficient, const size_t length )
+{
+  kernel_choice.kernel( dst, src, coefficient, length );
+}
+
+const char * gf256_kernel_name()
+{
+  return kernel_choice.name;
+}
+
+const size_t FecParams::OVERHEAD = ContestMessage::Header::WIRE_SIZE + ParityHeader::WIRE_SIZE + 2;
+
+static void check_params( const FecParams & params )
+{
+  /* the Cauchy matrix needs K + M distinct field elements */
+  if ( params.data_count < 1 or params.parity_count < 1 or params.data_count + params.parity_count > 256
+       or (params.code == FecParams::Code::XOR and params.parity_count != 1) ) {
+    throw runtime_error( "invalid FEC parameters " + params.to_string() );
+  }
+}
+
+FecParams::FecParams( const Code s_code, const unsigned int s_data_count,
+		      const unsigned int s_parity_count )
+  : code( s_code ),
+    data_count( s_data_count ),
+    parity_count( s_parity_count )
+{
+  check_params( *this );
+}
+
+/* from a command-line spec: "xor:K" or "rs:K:M" */
+FecParams::FecParams( const string & spec )
+  : code( Code::XOR ),
+    data_count( 0 ),
+    parity_count( 1 )
+{
+  const size_t colon = spec.find( ':' );
+  const string name = spec.substr( 0, colon );
+
+  try {
+    if ( name == "xor" and colon != string::npos ) {
+      data_count = stoul( spec.substr( colon + 1 ) );
+    } else if ( name == "rs" and colon != string::npos ) {
+      const size_t second = spec.find( ':', colon + 1 );
+      if ( second == string::npos ) {
+	throw runtime_error( "missing parity count" );
+      }
+      code = Code::ReedSolomon;
+      data_count = stoul( spec.substr( colon + 1, second - colon - 1 ) );
+      parity_count = stoul( spec.substr( second + 1 ) );
+    } else {
+      throw runtime_error( "unknown code" );
+    }
+  } catch ( const exception & ) {
+    throw runtime_error( "FEC spec \"" + spec + "\" is not xor:K or rs:K:M" );
+  }
+
+  check_params( *this );
+}
+
+/* coefficient of data datagram i in parity datagram j: all ones for XOR;
+   for Reed-Solomon, the Cauchy matrix 1 / (x_j + y_i) with x_j = K + j
+   and y_i = i, every square submatrix of which is invertible */
+uint8_t FecParams::coefficient( const unsigned int j, const unsigned int i ) const
+{
+  if ( code == Code::XOR ) {
+    return 1;
+  }
+  return gf256_inverse( uint8_t( (data_count + j) ^ i ) );
+}
+
+string FecParams::to_string() const
+{
+  if ( code == Code::XOR ) {
+    return "xor:" + std::to_string( data_count );
+  }
+  return "rs:" + std::to_string( data_count ) + ":" + std::to_string( parity_count );
+}
+
+ParityHeader::ParityHeader( const uint64_t s_first_sequence_number, const FecParams & params,
+			    const uint8_t s_index, const uint16_t s_symbol_size )
+  : first_sequence_number( s_first_sequence_number ),
+    code( params.code ),
+    data_count( params.data_count ),
+    parity_count( params.parity_count ),
+    index( s_index ),
+    symbol_size( s_symbol_size )
+{}
+
+/* Parse header from the start of a payload */
+ParityHeader::ParityHeader( const string & payload )
+  : first_sequence_number(), code(), data_count(), parity_count(), index(), symbol_size()
+{
+  if ( payload.size() < WIRE_SIZE ) {
+    throw runtime_error( "parity payload too small to contain parity header" );
+  }
+
+  memcpy( &first_sequence_number, payload.data(), sizeof( first_sequence_number ) );
+  memcpy( &symbol_size, payload.data() + 12, sizeof( symbol_size ) );
+  first_sequence_number = be64toh( first_sequence_number );
+  symbol_size = be16toh( symbol_size );
+
+  code = FecParams::Code( payload[ 8 ] );
+  data_count = payload[ 9 ];
+  parity_count = payload[ 10 ];
+  index = payload[ 11 ];
+
+  /* throws if the group is not one a sender could make */
+  FecParams( code, data_count, parity_count );
+
+  if ( index >= parity_count or payload.size() != WIRE_SIZE + symbol_size ) {
+    throw runtime_error( "malformed parity datagram" );
+  }
+}
+
+/* Make wire representation of header */
+string ParityHeader::to_string() const
+{
+  const uint64_t first = htobe64( first_sequence_number );
+  const uint16_t size = htobe16( symbol_size );
+
+  char out[ WIRE_SIZE ];
+  memcpy( out, &first, sizeof( first ) );
+  out[ 8 ] = char( code );
+  out[ 9 ] = char( data_count );
+  out[ 10 ] = char( parity_count );
+  out[ 11 ] = char( index );
+  memcpy( out + 12, &size, sizeof( size ) );
+  return string( out, sizeof( out ) );
+}
+
+GroupReport::GroupReport( const uint64_t s_first_sequence_number, const uint8_t s_data_count,
+			  const uint8_t s_recovered, const uint8_t s_unrecovered )
+  : first_sequence_number( s_first_sequence_number ),
+    data_count( s_data_count ),
+    recovered( s_recovered ),
+    unrecovered( s_unrecovered )
+{}
+
+GroupReport::GroupReport( const string & payload )
+  : first_sequence_number(), data_count(), recovered(), unrecovered()
+{
+  if ( payload.size() < WIRE_SIZE ) {
+    throw runtime_error( "group report too small" );
+  }
+
+  memcpy( &first_sequence_number, payload.data(), sizeof( first_sequence_number ) );
+  first_sequence_number = be64toh( first_sequence_number );
+  data_count = payload[ 8 ];
+  recovered = payload[ 9 ];
+  unrecovered = payload[ 10 ];
+}
+
+string GroupReport::to_string() const
+{
+  const uint64_t first = htobe64( first_sequence_number );
+
+  char out[ WIRE_SIZE ];
+  memcpy( out, &first, sizeof( first ) );
+  out[ 8 ] = char( data_count );
+  out[ 9 ] = char( recovered );
+  out[ 10 ] = char( unrecovered );
+  return string( out, sizeof( out ) );
+}
+
+/* add coefficient times a datagram's symbol (its length, then
+   its bytes; the padding is zero and adds nothing) */
+static void add_symbol( uint8_t * const symbol, const string & datagram, const uint8_t coefficient )
+{
+  const uint8_t length[ 2 ] = { uint8_t( datagram.size() >> 8 ), uint8_t( datagram.size() ) };
+  gf256_mul_add( symbol, length, coefficient, sizeof( length ) );
+  gf256_mul_add( symbol + sizeof( length ), reinterpret_cast<const uint8_t *>( datagram.data() ),
+		 coefficient, datagram.size() );
+}
+
+FecEncoder::FecEncoder( const FecParams & params )
+  : params_( params ),
+    first_sequence_number_( 0 ),
+    group_()
+{
+  group_.reserve( params_.data_count );
+}
+
+/* a flow datagram was sent; once it completes its group, the group's
+   parity payloads are returned (and the next group starts) */
+vector<string> FecEncoder::add( const uint64_t sequence_number, const string & datagram )
+{
+  /* a group is a run of consecutive sequence numbers */
+  if ( group_.empty() or sequence_number != first_sequence_number_ + group_.size() ) {
+    group_.clear();
+    first_sequence_number_ = sequence_number;
+  }
+
+  group_.push_back( datagram );
+  if ( group_.size() < params_.data_count ) {
+    return {};
+  }
+
+  size_t longest = 0;
+  for ( const auto & member : group_ ) {
+    longest = max( longest, member.size() );
+  }
+  const uint16_t symbol_size = 2 + longest;
+
+  vector<string> payloads;
+  for ( unsigned int j = 0; j < params_.parity_count; j++ ) {
+    string payload = ParityHeader( first_sequence_number_, params_, j, symbol_size ).to_string()
+      + string( symbol_size, 0 );
+    uint8_t * const symbol = reinterpret_cast<uint8_t *>( &payload[ ParityHeader::WIRE_SIZE ] );
+
+    for ( unsigned int i = 0; i < group_.size(); i++ ) {
+      add_symbol( symbol, group_[ i ], params_.coefficient( j, i ) );
+    }
+    payloads.push_back( move( payload ) );
+  }
+
+  group_.clear();
+  return payloads;
+}
+
+FecDecoder::FecDecoder()
+  : recent_( SLOTS ),
+    pending_(),
+    settled_before_( 0 )
+{}
+
+bool FecDecoder::have( const uint64_t sequence_number ) const
+{
+  return recent_[ sequence_number % SLOTS ].sequence_number == sequence_number;
+}
+
+/* a flow datagram arrived */
+void FecDecoder::remember( const uint64_t sequence_number, const char * const data, const size_t length )
+{
+  Slot & slot = recent_[ sequence_number % SLOTS ];
+  slot.sequence_number = sequence_number;
+  slot.datagram.assign( data, length );
+}
+
+/* invert a square matrix over GF(256) in place, by Gauss-Jordan elimination */
+static void invert( vector<vector<uint8_t>> & matrix )
+{
+  const size_t n = matrix.size();
+  vector<vector<uint8_t>> inverse( n, vector<uint8_t>( n ) );
+  for ( size_t i = 0; i < n; i++ ) {
+    inverse[ i ][ i ] = 1;
+  }
+
+  for ( size_t column = 0; column < n; column++ ) {
+    size_t pivot = column;
+    while ( pivot < n and matrix[ pivot ][ column ] == 0 ) {
+      pivot++;
+    }
+    if ( pivot == n ) {
+      throw runtime_error( "FEC decoding matrix is singular" );
+    }
+    swap( matrix[ pivot ], matrix[ column ] );
+    swap( inverse[ pivot ], inverse[ column ] );
+
+    const uint8_t scale = gf256_inverse( matrix[ column ][ column ] );
+    for ( size_t k = 0; k < n; k++ ) {
+      matrix[ column ][ k ] = gf256_mul( matrix[ column ][ k ], scale );
+      inverse[ column ][ k ] = gf256_mul( inverse[ column ][ k ], scale );
+    }
+
+    for ( size_t row = 0; row < n; row++ ) {
+      const uint8_t factor = matrix[ row ][ column ];
+      if ( row == column or factor == 0 ) {
+	continue;
+      }
+      gf256_mul_add( matrix[ row ].data(), matrix[ column ].data(), factor, n );
+      gf256_mul_add( inverse[ row ].data(), inverse[ column ].data(), factor, n );
+    }
+  }
+
+  matrix = move( inverse );
+}
+
+/* rebuild the group's lost datagrams if enough parity is in; true once
+   the group is settled (nothing lost, rebuilt, or beyond repair) */
+bool FecDecoder::try_recover( PendingGroup & group, vector<string> & recovered,
+			      vector<GroupReport> & reports )
+{
+  const ParityHeader & header = group.header;
+  const FecParams params( header.code, header.data_count, header.parity_count );
+
+  vector<unsigned int> missing;
+  for ( unsigned int i = 0; i < header.data_count; i++ ) {
+    if ( not have( header.first_sequence_number + i ) ) {
+      missing.push_back( i );
+    }
+  }
+
+  if ( missing.empty() ) {
+    return true;
+  }
+
+  if ( group.parity.size() < missing.size() ) {
+    if ( group.parity.size() < header.parity_count ) {
+      return false; /* more parity may yet arrive */
+    }
+    reports.emplace_back( header.first_sequence_number, header.data_count, 0, missing.size() );
+    return true;
+  }
+
+  /* subtract the datagrams we have from each parity symbol, leaving
+     sums of only the missing ones */
+  const size_t symbol_size = header.symbol_size;
+  vector<string> sums;
+  vector<unsigned int> rows;
+  for ( const auto & parity : group.parity ) {
+    if ( sums.size() == missing.size() ) {
+      break;
+    }
+
+    string sum = parity.second;
+    for ( unsigned int i = 0; i < header.data_count; i++ ) {
+      const uint64_t sequence_number = header.first_sequence_number + i;
+      if ( not have( sequence_number ) ) {
+	continue;
+      }
+      const string & datagram = recent_[ sequence_number % SLOTS ].datagram;
+      if ( datagram.size() + 2 > symbol_size ) {
+	throw runtime_error( "datagram longer than its group's parity" );
+      }
+      add_symbol( reinterpret_cast<uint8_t *>( &sum[ 0 ] ), datagram, params.coefficient( parity.first, i ) );
+    }
+    sums.push_back( move( sum ) );
+    rows.push_back( parity.first );
+  }
+
+  /* solve for the missing datagrams */
+  vector<vector<uint8_t>> matrix( missing.size(), vector<uint8_t>( missing.size() ) );
+  for ( size_t r = 0; r < rows.size(); r++ ) {
+    for ( size_t m = 0; m < missing.size(); m++ ) {
+      matrix[ r ][ m ] = params.coefficient( rows[ r ], missing[ m ] );
+    }
+  }
+  invert( matrix );
+
+  for ( size_t m = 0; m < missing.size(); m++ ) {
+    string symbol( symbol_size, 0 );
+    for ( size_t r = 0; r < rows.size(); r++ ) {
+      gf256_mul_add( reinterpret_cast<uint8_t *>( &symbol[ 0 ] ),
+		     reinterpret_cast<const uint8_t *>( sums[ r ].data() ),
+		     matrix[ m ][ r ], symbol_size );
+    }
+
+    const size_t length = (uint8_t( symbol[ 0 ] ) << 8) | uint8_t( symbol[ 1 ] );
+    if ( length + 2 > symbol_size ) {
+      throw runtime_error( "rebuilt datagram has impossible length" );
+    }
+
+    remember( header.first_sequence_number + missing[ m ], symbol.data() + 2, length );
+    recovered.push_back( symbol.substr( 2, length ) );
+  }
+
+  reports.emplace_back( header.first_sequence_number, header.data_count, missing.size(), 0 );
+  return true;
+}
+
+/* a parity datagram arrived: any datagrams it rebuilds are added to
+   recovered, and groups now settled with losses to reports */
+void FecDecoder::got_parity( const string & payload, vector<string> & recovered,
+			     vector<GroupReport> & reports )
+{
+  const ParityHeader header( payload );
+  const uint64_t first = header.first_sequence_number;
+
+  if ( first < settled_before_ ) {
+    return; /* the group was already rebuilt or given up on */
+  }
+
+  /* parity of a newer group means no more is coming for older ones */
+  while ( not pending_.empty() and pending_.begin()->first < first ) {
+    PendingGroup & old = pending_.begin()->second;
+    unsigned int lost = 0;
+    for ( unsigned int i = 0; i < old.header.data_count; i++ ) {
+      lost += not have( old.header.first_sequence_number + i );
+    }
+    if ( lost ) {
+      reports.emplace_back( old.header.first_sequence_number, old.header.data_count, 0, lost );
+    }
+    settled_before_ = max( settled_before_, old.header.first_sequence_number + old.header.data_count );
+    pending_.erase( pending_.begin() );
+  }
+
+  auto group = pending_.find( first );
+  if ( group == pending_.end() ) {
+    group = pending_.emplace( first, PendingGroup { header, {} } ).first;
+  }
+  group->second.parity[ header.index ] = payload.substr( ParityHeader::WIRE_SIZE );
+
+  if ( try_recover( group->second, recovered, reports ) ) {
+    settled_before_ = max( settled_before_, first + header.data_count );
+    pending_.erase( group );
+  }
+}
+
+AckHoldback::AckHoldback( const FecParams & params )
+  : next_expected_( 0 ),
+    patience_( 2 * (params.data_count + params.parity_count) ),
+    held_()
+{}
+
+/* hand on held acks that are now in order */
+void AckHoldback::drain( const Deliver & deliver )
+{
+  while ( not held_.empty() and held_.begin()->first <= next_expected_ ) {
+    deliver( held_.begin()->second );
+    next_expected_ = max( next_expected_, held_.begin()->first + 1 );
+    held_.erase( held_.begin() );
+  }
+}
+
+/* an ack arrived */
+void AckHoldback::ack( const Ack & ack, const Deliver & deliver )
+{
+  if ( ack.sequence_number < next_expected_ ) {
+    deliver( ack ); /* late, after its gap was passed over */
+    return;
+  }
+
+  held_.emplace( ack.sequence_number, ack );
+  drain( deliver );
+
+  /* a gap this far back is not going to be filled */
+  while ( not held_.empty() and held_.rbegin()->first >= next_expected_ + patience_ ) {
+    next_expected_ = held_.begin()->first;
+    drain( deliver );
+  }
+}
+
+/* the receiver cannot rebuild datagrams before this one */
+void AckHoldback::give_up_before( const uint64_t sequence_number, const Deliver & deliver )
+{
+  next_expected_ = max( next_expected_, sequence_number );
+  drain( deliver );
+}
+
+/* hand on everything held (after a timeout) */
+void AckHoldback::flush( const Deliver & deliver )
+{
+  if ( not held_.empty() ) {
+    next_expected_ = max( next_expected_, held_.rbegin()->first );
+  }
+  drain( deliver );
+}
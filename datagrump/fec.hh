@@ -0,0 +1,181 @@
+#ifndef FEC_HH
+#define FEC_HH
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "contest_message.hh"
+
+/* Forward error correction: the sender follows every group of K flow
+   datagrams with M parity datagrams, and the receiver rebuilds up to M
+   lost datagrams of a group from the rest. Each datagram is protected
+   whole (header and payload), behind a two-byte length, zero-padded to
+   the longest in its group. */
+
+/* GF(256) multiply-accumulate, dst[ i ] ^= coefficient * src[ i ],
+   with the fastest kernel this CPU supports (picked once, at startup) */
+void gf256_mul_add( uint8_t * const dst, const uint8_t * const src,
+		    const uint8_t coefficient, const size_t length );
+
+/* the portable kernel, and the name of the one in use */
+void gf256_mul_add_scalar( uint8_t * const dst, const uint8_t * const src,
+			   const uint8_t coefficient, const size_t length );
+const char * gf256_kernel_name();
+
+struct FecParams
+{
+  /* XOR: one parity datagram, the sum of the group.
+     ReedSolomon: M parity datagrams from a Cauchy matrix, so any K
+     of the group's K + M datagrams rebuild it. */
+  enum class Code : uint8_t { XOR = 0, ReedSolomon = 1 };
+
+  Code code;
+  unsigned int data_count, parity_count; /* K and M */
+
+  /* bytes each flow datagram gives up, so a parity datagram
+     (header, parity header, length and symbol) is no bigger */
+  static const size_t OVERHEAD;
+
+  FecParams( const Code s_code, const unsigned int s_data_count,
+	     const unsigned int s_parity_count );
+
+  /* from a command-line spec: "xor:K" or "rs:K:M" */
+  FecParams( const std::string & spec );
+
+  /* coefficient of data datagram i in parity datagram j */
+  uint8_t coefficient( const unsigned int j, const unsigned int i ) const;
+
+  std::string to_string() const;
+};
+
+/* starts a parity datagram's payload */
+struct ParityHeader
+{
+  uint64_t first_sequence_number; /* of the group's data datagrams */
+  FecParams::Code code;
+  uint8_t data_count, parity_count, index;
+  uint16_t symbol_size; /* length prefix plus the longest datagram */
+
+  static const size_t WIRE_SIZE = sizeof( uint64_t ) + 4 + sizeof( uint16_t );
+
+  ParityHeader( const uint64_t s_first_sequence_number, const FecParams & params,
+		const uint8_t s_index, const uint16_t s_symbol_size );
+
+  /* Parse header from the start of a payload */
+  ParityHeader( const std::string & payload );
+
+  /* Make wire representation of header */
+  std::string to_string() const;
+};
+
+/* the receiver's account of a group that lost datagrams,
+   the payload of a parity-class ack */
+struct GroupReport
+{
+  uint64_t first_sequence_number;
+  uint8_t data_count, recovered, unrecovered;
+
+  static const size_t WIRE_SIZE = sizeof( uint64_t ) + 3;
+
+  GroupReport( const uint64_t s_first_sequence_number, const uint8_t s_data_count,
+	       const uint8_t s_recovered, const uint8_t s_unrecovered );
+  GroupReport( const std::string & payload );
+  std::string to_string() const;
+};
+
+/* sender side: gathers the datagrams of each group and computes its parity */
+class FecEncoder
+{
+private:
+  FecParams params_;
+  uint64_t first_sequence_number_;
+  std::vector<std::string> group_;
+
+public:
+  FecEncoder( const FecParams & params );
+
+  /* a flow datagram was sent; once it completes its group, the group's
+     parity payloads are returned (and the next group starts) */
+  std::vector<std::string> add( const uint64_t sequence_number, const std::string & datagram );
+};
+
+/* receiver side: remembers recent datagrams, and rebuilds lost ones
+   when enough of their group's parity arrives */
+class FecDecoder
+{
+private:
+  static const uint64_t SLOTS = 1024; /* recent datagrams kept, by sequence number */
+
+  struct Slot
+  {
+    uint64_t sequence_number = -1;
+    std::string datagram = "";
+  };
+  std::vector<Slot> recent_;
+
+  /* parity held for groups not yet rebuilt (by first sequence number) */
+  struct PendingGroup
+  {
+    ParityHeader header;
+    std::map<uint8_t, std::string> parity; /* symbols, by index */
+  };
+  std::map<uint64_t, PendingGroup> pending_;
+  uint64_t settled_before_; /* parity for groups before this is stale */
+
+  bool have( const uint64_t sequence_number ) const;
+  bool try_recover( PendingGroup & group, std::vector<std::string> & recovered,
+		    std::vector<GroupReport> & reports );
+
+public:
+  FecDecoder();
+
+  /* a flow datagram arrived */
+  void remember( const uint64_t sequence_number, const char * const data, const size_t length );
+
+  /* a parity datagram arrived: any datagrams it rebuilds are added to
+     recovered, and groups now settled with losses to reports */
+  void got_parity( const std::string & payload, std::vector<std::string> & recovered,
+		   std::vector<GroupReport> & reports );
+};
+
+/* Sender side: with FEC, a lost datagram's ack may still come, late,
+   once the receiver rebuilds it. Acks are handed on in sequence order,
+   holding later ones back while a gap might yet be filled; the gap is
+   passed over (and seen as a loss) once the receiver reports the group
+   unrecoverable, or too many later acks pile up behind it. */
+class AckHoldback
+{
+public:
+  struct Ack
+  {
+    uint64_t sequence_number, send_timestamp, recv_timestamp, arrival_timestamp;
+    std::string payload;
+    uint32_t ce_count; /* the receiver's count of CE marks */
+  };
+
+  typedef std::function<void( const Ack & )> Deliver;
+
+private:
+  uint64_t next_expected_;
+  uint64_t patience_; /* later acks held before giving up on a gap */
+  std::map<uint64_t, Ack> held_;
+
+  void drain( const Deliver & deliver );
+
+public:
+  AckHoldback( const FecParams & params );
+
+  /* an ack arrived */
+  void ack( const Ack & ack, const Deliver & deliver );
+
+  /* the receiver cannot rebuild datagrams before this one */
+  void give_up_before( const uint64_t sequence_number, const Deliver & deliver );
+
+  /* hand on everything held (after a timeout) */
+  void flush( const Deliver & deliver );
+};
+
+#endif /* FEC_HH */
@@ -0,0 +1,124 @@
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "metrics_cache.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const uint32_t METRICS_MAGIC = 0x6d747263; /* "mtrc" */
+
+/* holds an flock on the cache file for its lifetime */
+class FileLock
+{
+private:
+  int fd_;
+
+public:
+  FileLock( const FileDescriptor & file, const int operation )
+    : fd_( file.fd_num() )
+  {
+    SystemCall( "flock", flock( fd_, operation ) );
+  }
+
+  ~FileLock()
+  {
+    flock( fd_, LOCK_UN );
+  }
+};
+
+/* open (or create) the cache file */
+MetricsCache::MetricsCache( const string & path )
+  : path_( path ),
+    file_( SystemCall( "open " + path, open( path.c_str(), O_RDWR | O_CREAT, 0644 ) ) ),
+    region_(),
+    table_( nullptr )
+{
+  const FileLock lock( file_, LOCK_EX );
+
+  struct stat info;
+  SystemCall( "fstat", fstat( file_.fd_num(), &info ) );
+  if ( info.st_size != 0 and info.st_size != sizeof( Table ) ) {
+    throw runtime_error( path_ + " is not a datagrump metrics cache" );
+  }
+
+  /* a new file is extended with zeros: every entry unused */
+  SystemCall( "ftruncate", ftruncate( file_.fd_num(), sizeof( Table ) ) );
+  region_.reset( new MMapRegion( sizeof( Table ), PROT_READ | PROT_WRITE, MAP_SHARED, file_.fd_num() ) );
+  table_ = reinterpret_cast<Table *>( region_->addr() );
+
+  if ( info.st_size == 0 ) {
+    table_->magic = METRICS_MAGIC;
+    table_->slots = SLOTS;
+  } else if ( table_->magic != METRICS_MAGIC or table_->slots != SLOTS ) {
+    throw runtime_error( path_ + " is not a datagrump metrics cache" );
+  }
+}
+
+/* the entry for this key, or null */
+MetricsCache::Entry * MetricsCache::find( const string & key )
+{
+  for ( Entry & entry : table_->entries ) {
+    if ( entry.updated_s and strncmp( entry.key, key.c_str(), KEY_SIZE ) == 0 ) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+/* this peer's metrics, decayed for their age; false if none are fresh */
+bool MetricsCache::lookup( const Address & peer, PathMetrics & metrics )
+{
+  const FileLock lock( file_, LOCK_SH );
+
+  const Entry * const entry = find( peer.ip() );
+  if ( not entry ) {
+    return false;
+  }
+
+  const uint64_t now = time( nullptr );
+  const uint64_t age = now > entry->updated_s ? now - entry->updated_s : 0;
+  if ( age > MAX_AGE_S ) {
+    return false;
+  }
+
+  const double decay = pow( 0.5, double( age ) / HALF_LIFE_S );
+  metrics = entry->metrics;
+  metrics.window *= decay;
+  metrics.loss_window *= decay;
+  return true;
+}
+
+/* record this peer's metrics (replacing the least recently
+   updated entry if the table is full) */
+void MetricsCache::store( const Address & peer, const PathMetrics & metrics )
+{
+  const string key = peer.ip();
+  if ( key.size() >= KEY_SIZE ) {
+    throw runtime_error( "address too long for metrics cache: " + key );
+  }
+
+  const FileLock lock( file_, LOCK_EX );
+
+  Entry * entry = find( key );
+  if ( not entry ) {
+    entry = &table_->entries[ 0 ];
+    for ( Entry & candidate : table_->entries ) {
+      if ( candidate.updated_s < entry->updated_s ) {
+	entry = &candidate;
+      }
+    }
+    memset( entry->key, 0, KEY_SIZE );
+    memcpy( entry->key, key.data(), key.size() );
+  }
+
+  entry->metrics = metrics;
+  entry->updated_s = time( nullptr );
+}
@@ -0,0 +1,73 @@
+#ifndef METRICS_CACHE_HH
+#define METRICS_CACHE_HH
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "address.hh"
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+
+/* what a sender learned about the path to a destination */
+struct PathMetrics
+{
+  double min_rtt = 0; /* ms */
+  double window = 0; /* datagrams in flight the path sustained */
+  double loss_window = 0; /* window at the last loss (0 if none) */
+};
+
+/* Per-destination path metrics that outlive the sender, like the
+   kernel's tcp_metrics: a small table in a memory-mapped file, keyed by
+   the peer's IP address (every port on a host shares the path), shared
+   by all senders on the machine and locked with flock while in use.
+   Entries age: windows decay by half every HALF_LIFE_S, and entries
+   older than MAX_AGE_S are ignored. */
+class MetricsCache
+{
+private:
+  static const size_t SLOTS = 256;
+  static const size_t KEY_SIZE = 48; /* an IPv6 address as text, and its terminator */
+  static const uint64_t HALF_LIFE_S = 600;
+  static const uint64_t MAX_AGE_S = 3600;
+
+  struct Entry
+  {
+    char key[ KEY_SIZE ];
+    uint64_t updated_s; /* wall-clock time of the last store, 0 if unused */
+    PathMetrics metrics;
+  };
+
+  struct Table
+  {
+    uint32_t magic;
+    uint32_t slots;
+    Entry entries[ SLOTS ];
+  };
+
+  std::string path_;
+  FileDescriptor file_;
+  std::unique_ptr<MMapRegion> region_;
+  Table * table_;
+
+  Entry * find( const std::string & key );
+
+public:
+  /* open (or create) the cache file */
+  MetricsCache( const std::string & path );
+
+  /* this peer's metrics, decayed for their age; false if none are fresh */
+  bool lookup( const Address & peer, PathMetrics & metrics );
+
+  /* record this peer's metrics (replacing the least recently
+     updated entry if the table is full) */
+  void store( const Address & peer, const PathMetrics & metrics );
+
+  const std::string & path() const { return path_; }
+
+  /* forbid copying or assigning */
+  MetricsCache( const MetricsCache & other ) = delete;
+  MetricsCache & operator=( const MetricsCache & other ) = delete;
+};
+
+#endif /* METRICS_CACHE_HH */
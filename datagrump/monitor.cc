@@ -0,0 +1,126 @@
+/* sample the live stats published by a running sender or receiver */
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include <dirent.h>
+#include <signal.h>
+
+#include "stats.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* list the segments of all running senders and receivers */
+static int list_segments()
+{
+  DIR * const dir = opendir( StatsSegment::directory );
+  if ( not dir ) {
+    cerr << "opendir " << StatsSegment::directory << ": " << strerror( errno ) << endl;
+    return EXIT_FAILURE;
+  }
+
+  while ( const dirent * const entry = readdir( dir ) ) {
+    const string name = entry->d_name;
+    if ( name.compare( 0, 10, "datagrump-" ) != 0 ) {
+      continue;
+    }
+
+    /* segments of killed processes are left behind */
+    const StatsSegment segment( "/" + name );
+    const bool running = kill( segment.pid(), 0 ) == 0 or errno != ESRCH;
+    cout << segment.name() << (running ? "" : " (exited)") << endl;
+  }
+
+  closedir( dir );
+  return EXIT_SUCCESS;
+}
+
+static void print_sender( const SenderStats & s )
+{
+  cout << "t=" << s.timestamp
+       << " sent=" << s.datagrams_sent
+       << " acked=" << s.acks_received
+       << " bg=" << s.bg_datagrams_sent
+       << " cwnd=" << s.cwnd
+       << " dwnd=" << s.dwnd
+       << " rtt=" << s.rtt
+       << " base_rtt=" << s.base_rtt
+       << " fwd_delay=" << s.forward_delay
+       << " skew=" << s.clock_skew_ppm << "ppm"
+       << " timeouts=" << s.timeouts
+       << " losses=" << s.loss_events
+       << " random_losses=" << s.random_losses
+       << " local socket/queue full=" << s.local_socket_full << "/" << s.local_queue_full
+       << " ecn marks/cuts/alpha=" << s.ce_marks << "/" << s.ecn_cuts << "/" << s.ecn_fraction
+       << " fec parity/recovered/unrecovered=" << s.fec_parity_sent
+       << "/" << s.fec_recovered << "/" << s.fec_unrecovered
+       << " shared window/share/losses=" << s.shared_window
+       << "/" << s.window_share << "/" << s.shared_loss_events << endl;
+}
+
+static void print_receiver( const ReceiverStats & s )
+{
+  cout << "t=" << s.timestamp
+       << " received=" << s.datagrams_received
+       << " bytes=" << s.bytes_received
+       << " bg=" << s.bg_datagrams_received
+       << " acks=" << s.acks_sent
+       << " throughput=" << s.throughput_mbps << " Mbps"
+       << " delay p50/p95/p99=" << s.delay_p50
+       << "/" << s.delay_p95 << "/" << s.delay_p99 << " ms"
+       << " fec parity/recovered/unrecovered=" << s.fec_parity_received
+       << "/" << s.fec_recovered << "/" << s.fec_unrecovered
+       << " ecn ect/ce=" << s.ect_received << "/" << s.ce_received << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+  /* check the command-line arguments */
+  if ( argc < 1 ) { /* for sticklers */
+    abort();
+  }
+
+  if ( argc == 1 ) {
+    try {
+      return list_segments();
+    } catch ( const exception & e ) {
+      print_exception( e );
+      return EXIT_FAILURE;
+    }
+  } else if ( argc > 3 ) {
+    cerr << "Usage: " << argv[ 0 ] << " [SEGMENT] [INTERVAL_MS]" << endl;
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int interval_ms = argc == 3 ? atoi( argv[ 2 ] ) : 1000;
+
+  cout << fixed << setprecision( 2 );
+
+  try {
+    const StatsSegment segment( argv[ 1 ] );
+    cerr << "Sampling " << segment.name() << " (pid " << segment.pid() << ")" << endl;
+
+    while ( true ) {
+      switch ( segment.kind() ) {
+      case StatsSegment::Kind::Sender:
+	print_sender( segment.read<SenderStats>() );
+	break;
+      case StatsSegment::Kind::Receiver:
+	print_receiver( segment.read<ReceiverStats>() );
+	break;
+      }
+
+      this_thread::sleep_for( chrono::milliseconds( interval_ms ) );
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+
+#include "one_way_delay.hh"
+
+using namespace std;
+
+OneWayDelay::OneWayDelay()
+  : history_(),
+    next_( 0 ),
+    current_( { INFINITY, 0 } ),
+    window_end_( 0 ),
+    skew_( 0 ),
+    intercept_( INFINITY )
+{}
+
+/* retire the window in progress, and re-estimate the skew and base delay */
+void OneWayDelay::end_window()
+{
+  if ( history_.size() < WINDOWS ) {
+    history_.push_back( current_ );
+  } else {
+    history_[ next_ ] = current_;
+    next_ = (next_ + 1) % WINDOWS;
+  }
+
+  /* oldest first */
+  const size_t count = history_.size();
+  auto at = [&] ( const size_t i ) -> const Minimum & {
+    return history_[ (next_ + i) % count ];
+  };
+
+  if ( count >= 4 ) {
+    Minimum older = at( 0 ), newer = at( count / 2 );
+    for ( size_t i = 0; i < count; i++ ) {
+      Minimum & lowest = i < count / 2 ? older : newer;
+      if ( at( i ).delay < lowest.delay ) {
+	lowest = at( i );
+      }
+    }
+
+    /* smoothed: the timestamps are whole milliseconds, so one slope
+       alone is noisy */
+    const double slope = (newer.delay - older.delay) / (double( newer.time ) - double( older.time ));
+    skew_ += (max( -MAX_SKEW, min( slope, MAX_SKEW ) ) - skew_) / 8;
+  }
+
+  intercept_ = INFINITY;
+  for ( const Minimum & minimum : history_ ) {
+    intercept_ = min( intercept_, minimum.delay - skew_ * minimum.time );
+  }
+}
+
+/* add a sample and return its queueing delay in ms (0 if none) */
+double OneWayDelay::sample( const uint64_t send_timestamp, const uint64_t recv_timestamp )
+{
+  if ( send_timestamp >= window_end_ ) {
+    if ( not isinf( current_.delay ) ) {
+      end_window();
+    }
+    current_ = { INFINITY, send_timestamp };
+    window_end_ = send_timestamp + WINDOW_MS;
+  }
+
+  const double delay = double( int64_t( recv_timestamp - send_timestamp ) );
+  if ( delay < current_.delay ) {
+    current_ = { delay, send_timestamp };
+  }
+
+  return max( delay - offset( send_timestamp ), 0.0 );
+}
+
+/* estimated receiver clock minus sender clock at this time, in ms
+   (plus the path's propagation delay, which cannot be told apart) */
+double OneWayDelay::offset( const uint64_t time ) const
+{
+  return min( intercept_, current_.delay - skew_ * current_.time ) + skew_ * time;
+}
@@ -0,0 +1,58 @@
+#ifndef ONE_WAY_DELAY_HH
+#define ONE_WAY_DELAY_HH
+
+#include <cstdint>
+#include <vector>
+
+/* Forward (sender to receiver) queueing delay, from the receiver's
+   timestamps. Those are on an unsynchronized clock, so a raw sample,
+   receive time minus send time, is the one-way delay plus the offset
+   between the clocks, and the offset drifts as the clocks run at
+   slightly different rates.
+
+   The estimator keeps the smallest raw sample of each WINDOW_MS of
+   sending (the samples that saw an empty queue) for the last WINDOWS
+   windows. The skew between the clocks is the slope from the lowest
+   minimum in the older half of that history to the lowest in the newer
+   half, bounded by MAX_SKEW. The base delay now is the lowest minimum
+   carried forward by the skew since it was seen, and the queueing delay
+   is how far a sample is above it. Queueing on the ack path never enters
+   the estimate. */
+class OneWayDelay
+{
+private:
+  static const uint64_t WINDOW_MS = 1000;
+  static const size_t WINDOWS = 16;
+  static constexpr double MAX_SKEW = 500e-6; /* clock rates within 500 ppm */
+
+  struct Minimum
+  {
+    double delay; /* raw, in ms */
+    uint64_t time; /* sender's clock, in ms */
+  };
+
+  std::vector<Minimum> history_; /* ring of past windows' minima */
+  size_t next_;
+  Minimum current_; /* minimum of the window in progress */
+  uint64_t window_end_;
+
+  double skew_; /* receiver clock rate minus sender's */
+  double intercept_; /* lowest past minimum, carried back to time 0 */
+
+  void end_window();
+
+public:
+  OneWayDelay();
+
+  /* add a sample and return its queueing delay in ms (0 if none) */
+  double sample( const uint64_t send_timestamp, const uint64_t recv_timestamp );
+
+  /* estimated receiver clock minus sender clock at this time, in ms
+     (plus the path's propagation delay, which cannot be told apart) */
+  double offset( const uint64_t time ) const;
+
+  /* estimated clock skew, in parts per million */
+  double skew_ppm() const { return skew_ * 1e6; }
+};
+
+#endif /* ONE_WAY_DELAY_HH */
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+#include "rate_meter.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+RateMeter::RateMeter()
+  : cpu_(),
+    start_us_( 0 ),
+    start_cpu_( 0 ),
+    datagrams_sent_( 0 ),
+    datagrams_delivered_( 0 ),
+    bytes_delivered_( 0 ),
+    latencies_us_()
+{
+  reset();
+}
+
+/* start a new interval */
+void RateMeter::reset()
+{
+  start_us_ = timestamp_us();
+  start_cpu_ = cpu_.read();
+  datagrams_sent_ = datagrams_delivered_ = bytes_delivered_ = 0;
+  latencies_us_.clear();
+}
+
+/* microseconds since the interval started */
+uint64_t RateMeter::elapsed_us() const
+{
+  return timestamp_us() - start_us_;
+}
+
+/* one-line summary of the interval */
+string RateMeter::report( const string & label ) const
+{
+  const double seconds = max( uint64_t( 1 ), elapsed_us() ) / 1e6;
+  const uint64_t cpu = cpu_.read() - start_cpu_;
+  const uint64_t packets = max( uint64_t( 1 ), max( datagrams_sent_, datagrams_delivered_ ) );
+
+  ostringstream out;
+  out << fixed << setprecision( 2 ) << label << ": " << seconds << " s";
+
+  if ( datagrams_sent_ ) {
+    out << ", sent " << uint64_t( datagrams_sent_ / seconds ) << " pps";
+  }
+
+  out << ", delivered " << uint64_t( datagrams_delivered_ / seconds ) << " pps"
+      << ", goodput " << bytes_delivered_ * 8 / seconds / 1e6 << " Mbps"
+      << ", " << cpu / packets << " " << cpu_.unit() << "/packet";
+
+  if ( not latencies_us_.empty() ) {
+    vector<uint64_t> sorted = latencies_us_;
+    sort( sorted.begin(), sorted.end() );
+    out << ", ack latency p50/p99/max "
+	<< sorted[ sorted.size() / 2 ] << "/"
+	<< sorted[ sorted.size() * 99 / 100 ] << "/"
+	<< sorted.back() << " us";
+  }
+
+  return out.str();
+}
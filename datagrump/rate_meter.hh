@@ -0,0 +1,47 @@
+#ifndef RATE_METER_HH
+#define RATE_METER_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu_counter.hh"
+
+/* packet rate, goodput, CPU cost per packet and ack-loop latency
+   over an interval, for the loopback benchmark */
+class RateMeter
+{
+private:
+  CPUCounter cpu_;
+  uint64_t start_us_, start_cpu_;
+
+  uint64_t datagrams_sent_, datagrams_delivered_, bytes_delivered_;
+  std::vector<uint64_t> latencies_us_;
+
+public:
+  RateMeter();
+
+  /* start a new interval */
+  void reset();
+
+  /* a datagram was sent */
+  void sent() { datagrams_sent_++; }
+
+  /* a datagram (with this much payload) was received or acknowledged */
+  void delivered( const uint64_t payload_bytes )
+  {
+    datagrams_delivered_++;
+    bytes_delivered_ += payload_bytes;
+  }
+
+  /* time between sending a datagram and getting its ack */
+  void ack_latency( const uint64_t microseconds ) { latencies_us_.push_back( microseconds ); }
+
+  /* microseconds since the interval started */
+  uint64_t elapsed_us() const;
+
+  /* one-line summary of the interval */
+  std::string report( const std::string & label ) const;
+};
+
+#endif /* RATE_METER_HH */
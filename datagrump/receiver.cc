@@ -2,11 +2,24 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <getopt.h>
 
 #include "socket.hh"
+#include "uring.hh"
+#include "xdp_socket.hh"
+#include "poller.hh"
 #include "contest_message.hh"
+#include "stats.hh"
+#include "rate_meter.hh"
+#include "transfer.hh"
+#include "fec.hh"
+#include "timestamp.hh"
 
 using namespace std;
+using namespace PollerShortNames;
 
 #define PACKET_SIZE_BITS (1500 * 8)
 
@@ -76,19 +89,119 @@ double ThroughputTracker::get_throughput()
   return ewma_throughput_bps;
 }
 
-void prepare_and_send_ack(ContestMessage & message, UDPSocket & socket,
-        const UDPSocket::received_datagram & recd,
-        uint64_t & sequence_number) 
+/* recent one-way delays, relative to the smallest seen, for percentiles */
+class DelayTracker
 {
-    /* else,  assemble the acknowledgment */
-  message.transform_into_ack( sequence_number++, recd.timestamp );
+private:
+  static const size_t WINDOW = 1024;
 
-  /* timestamp the ack just before sending */
-  message.set_send_timestamp();
+  std::vector<int64_t> samples_; /* ring buffer of raw (unsynchronized) delays */
+  size_t next_;
+  int64_t min_delay_;
 
-  /* send the ack */
-  socket.sendto( recd.source_address, message.to_string() );
-}
+public:
+  DelayTracker() : samples_(), next_( 0 ), min_delay_( INT64_MAX ) {}
+
+  void add( const uint64_t send_timestamp, const uint64_t recv_timestamp )
+  {
+    const int64_t delay = int64_t( recv_timestamp - send_timestamp );
+    min_delay_ = min( min_delay_, delay );
+
+    if ( samples_.size() < WINDOW ) {
+      samples_.push_back( delay );
+    } else {
+      samples_[ next_ ] = delay;
+      next_ = (next_ + 1) % WINDOW;
+    }
+  }
+
+  /* fill in delay percentiles (in ms above the minimum) */
+  void summarize( ReceiverStats & stats ) const
+  {
+    if ( samples_.empty() ) {
+      return;
+    }
+
+    vector<int64_t> sorted = samples_;
+    sort( sorted.begin(), sorted.end() );
+    auto percentile = [&] ( const double p ) {
+      return double( sorted[ size_t( p * (sorted.size() - 1) ) ] - min_delay_ );
+    };
+
+    stats.delay_p50 = percentile( 0.50 );
+    stats.delay_p95 = percentile( 0.95 );
+    stats.delay_p99 = percentile( 0.99 );
+  }
+};
+
+/* optional receiver behavior, set from command-line flags */
+struct ReceiverOptions
+{
+  bool report = false; /* print packet rate and CPU cost every second */
+  bool gro = false; /* receive coalesced datagrams with UDP GRO */
+  bool uring = false; /* receive and send acks through io_uring */
+  string xdp_interface = ""; /* if set, receive and ack through AF_XDP on this interface */
+  string bg_port = ""; /* if set, also take (and drop) cross traffic on this port */
+  string output = ""; /* if set, write a transferred file here */
+};
+
+/* simple receiver class to acknowledge every datagram */
+class DatagrumpReceiver
+{
+private:
+  UDPSocket socket_;
+  ReceiverOptions options_;
+
+  uint64_t sequence_number_; /* next outgoing ack sequence number */
+  bool flow_started_; /* seen the first datagram of our flow */
+
+  ThroughputTracker tracker_;
+
+  /* datagrams are received into this buffer (big enough for a GRO batch) */
+  static const size_t RECEIVE_BUFFER_SIZE = 65536;
+  std::vector<char> receive_buffer_;
+
+  /* live stats, published to shared memory every STATS_INTERVAL ms */
+  static const uint64_t STATS_INTERVAL = 100;
+  StatsSegment stats_segment_;
+  ReceiverStats stats_;
+  DelayTracker delays_;
+
+  /* loopback benchmark: packet rate and CPU cost per packet */
+  static const uint64_t REPORT_INTERVAL_US = 1000000;
+  std::unique_ptr<RateMeter> meter_;
+
+  /* io_uring: acks are queued and submitted once per batch of completions */
+  std::unique_ptr<UringUDPSocket> uring_;
+
+  /* AF_XDP: bypass the kernel's UDP stack on one interface */
+  std::unique_ptr<XDPSocket> xdp_;
+
+  /* cross traffic sent to its own port lands here and is
+     dropped without being copied out of the kernel */
+  std::unique_ptr<UDPSocket> bg_sink_;
+
+  /* file transfer: payloads are chunks of the file */
+  std::unique_ptr<TransferSink> transfer_;
+
+  /* forward error correction: started by the sender's first parity
+     datagram, after which recent datagrams are kept to rebuild losses */
+  std::unique_ptr<FecDecoder> fec_;
+
+  void got_datagrams( const char * const data, const size_t length, const uint16_t segment_size,
+                      const uint64_t timestamp, const ECN ecn, const Address & source );
+  void got_datagram( const char * const data, const size_t length,
+                     const uint64_t timestamp, const ECN ecn, const Address & source );
+  void got_parity( const char * const data, const size_t length,
+                   const uint64_t timestamp, const Address & source );
+  void prepare_and_send_ack( ContestMessage & message, const uint64_t timestamp,
+                             const Address & source );
+  void send_ack( ContestMessage & ack, const Address & source );
+
+public:
+  DatagrumpReceiver( const char * const port, const ReceiverOptions & options );
+  int loop();
+};
 
 int main( int argc, char *argv[] )
 {
@@ -97,53 +210,303 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  if ( argc != 2 ) {
-    cerr << "Usage: " << argv[ 0 ] << " PORT" << endl;
+  /* flags come first; the port follows */
+  ReceiverOptions options;
+  const option flags[] = {
+    { "report", no_argument, nullptr, 'r' },
+    { "gro",    no_argument, nullptr, 'g' },
+    { "uring",  no_argument, nullptr, 'u' },
+    { "xdp",    required_argument, nullptr, 'x' },
+    { "bg-port", required_argument, nullptr, 'b' },
+    { "output", required_argument, nullptr, 'o' },
+    { nullptr,  0,           nullptr, 0 }
+  };
+
+  int flag;
+  while ( (flag = getopt_long( argc, argv, "", flags, nullptr )) != -1 ) {
+    switch ( flag ) {
+    case 'r': options.report = true; break;
+    case 'g': options.gro = true; break;
+    case 'u': options.uring = true; break;
+    case 'x': options.xdp_interface = optarg; break;
+    case 'b': options.bg_port = optarg; break;
+    case 'o': options.output = optarg; break;
+    default: return EXIT_FAILURE;
+    }
+  }
+
+  if ( not options.xdp_interface.empty() and (options.gro or options.uring) ) {
+    cerr << "--xdp cannot be combined with --gro or --uring" << endl;
     return EXIT_FAILURE;
   }
 
-  /* create UDP socket for incoming datagrams */
-  UDPSocket socket;
+  if ( argc - optind != 1 ) {
+    cerr << "Usage: " << argv[ 0 ] << " [--report] [--gro] [--uring] [--xdp=INTERFACE] [--bg-port=PORT] [--output=PATH] PORT" << endl;
+    return EXIT_FAILURE;
+  }
+
+  DatagrumpReceiver receiver( argv[ optind ], options );
+  return receiver.loop();
+}
+
+DatagrumpReceiver::DatagrumpReceiver( const char * const port, const ReceiverOptions & options )
+  : socket_(),
+    options_( options ),
+    sequence_number_( 0 ),
+    flow_started_( false ),
+    tracker_(),
+    receive_buffer_( RECEIVE_BUFFER_SIZE ),
+    stats_segment_( StatsSegment::default_name( "receiver" ), StatsSegment::Kind::Receiver ),
+    stats_(),
+    delays_(),
+    meter_(),
+    uring_(),
+    xdp_(),
+    bg_sink_(),
+    transfer_(),
+    fec_()
+{
+  /* start the clock (its epoch is set on first use) before any datagram
+     can arrive, so no kernel receive timestamp falls before the epoch */
+  timestamp_ms();
 
   /* turn on timestamps on receipt */
-  socket.set_timestamps();
+  socket_.set_timestamps();
+
+  /* and the ECN codepoint, to echo congestion marks to the sender */
+  socket_.set_receive_ecn();
+
+  /* coalesce runs of datagrams from the same flow into one receive */
+  if ( options_.gro ) {
+    socket_.set_gro();
+  }
 
   /* "bind" the socket to the user-specified local port number */
-  socket.bind( Address( "::0", argv[ 1 ] ) );
+  socket_.bind( Address( "::0", port ) );
 
-  cerr << "Listening on " << socket.local_address().to_string() << endl;
+  cerr << "Listening on " << socket_.local_address().to_string() << endl;
+  cerr << "Publishing stats to " << stats_segment_.name() << endl;
 
-  uint64_t sequence_number = 0;
+  if ( options_.report ) {
+    meter_.reset( new RateMeter );
+  }
 
-  ThroughputTracker tracker;
+  if ( not options_.output.empty() ) {
+    transfer_.reset( new TransferSink( options_.output ) );
+  }
 
-  /* Loop and acknowledge every incoming datagram back to its source */
-  while ( true ) {
+  if ( not options_.bg_port.empty() ) {
+    bg_sink_.reset( new UDPSocket );
+    bg_sink_->bind( Address( "::0", options_.bg_port ) );
+    cerr << "Dropping cross traffic on " << bg_sink_->local_address().to_string() << endl;
+  }
 
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
+  if ( options_.uring ) {
+    uring_.reset( new UringUDPSocket( socket_, [&] ( const UringUDPSocket::received_datagram_view & recd ) {
+	  got_datagrams( recd.data, recd.length, recd.segment_size, recd.timestamp, recd.ecn,
+			 recd.source_address );
+	} ) );
+    cerr << "Receiving and acking through io_uring" << endl;
+  }
 
-    if (message.payload[0] == 'c') {
-      /* we got one of our packets, continue. */
-      tracker.init(recd.timestamp, true);
-      prepare_and_send_ack(message, socket, recd, sequence_number);
-      break; 
-    }
+  if ( not options_.xdp_interface.empty() ) {
+    /* the kernel socket stays bound to keep the port reserved */
+    xdp_.reset( new XDPSocket( options_.xdp_interface ) );
+    xdp_->bind( socket_.local_address() );
+    cerr << "Receiving and acking through AF_XDP on " << options_.xdp_interface
+	 << " as " << xdp_->local_address().to_string() << endl;
   }
+}
 
-  while ( true ) {
-    const UDPSocket::received_datagram recd = socket.recv();
-    ContestMessage message = recd.payload;
+void DatagrumpReceiver::prepare_and_send_ack( ContestMessage & message, const uint64_t timestamp,
+                                              const Address & source )
+{
+    /* else,  assemble the acknowledgment */
+  message.transform_into_ack( sequence_number_++, timestamp );
+
+  /* tell a transfer's sender how far the file is complete */
+  if ( transfer_ ) {
+    message.payload = transfer_->ack_payload();
+  }
+
+  send_ack( message, source );
+}
+
+void DatagrumpReceiver::send_ack( ContestMessage & ack, const Address & source )
+{
+  /* answer in the compact format if the sender offered it */
+  if ( ack.header.accepts_compact ) {
+    ack.header.format = ContestMessage::WireFormat::Compact;
+  }
+
+  /* echo every CE mark so far, so a lost ack loses none */
+  ack.header.ack_ce_count = stats_.ce_received;
+
+  /* timestamp the ack just before sending */
+  ack.set_send_timestamp();
+
+  /* send the ack */
+  if ( uring_ ) {
+    uring_->sendto( source, ack.to_string() );
+  } else if ( xdp_ ) {
+    xdp_->sendto( source, ack.to_string() );
+  } else {
+    socket_.sendto( source, ack.to_string() );
+  }
+  stats_.acks_sent++;
+}
+
+/* rebuild what the parity datagram can, handle the rebuilt datagrams as
+   if they had just arrived, and report groups that lost datagrams
+   (with parity-class acks of the group's first datagram) */
+void DatagrumpReceiver::got_parity( const char * const data, const size_t length,
+                                    const uint64_t timestamp, const Address & source )
+{
+  const ContestMessage parity( data, length );
+
+  if ( not fec_ ) {
+    fec_.reset( new FecDecoder );
+    cerr << "Sender is sending FEC parity; rebuilding lost datagrams" << endl;
+  }
+  stats_.fec_parity_received++;
+
+  vector<string> recovered;
+  vector<GroupReport> reports;
+  fec_->got_parity( parity.payload, recovered, reports );
+
+  for ( const string & datagram : recovered ) {
+    stats_.fec_recovered++;
+    got_datagram( datagram.data(), datagram.size(), timestamp, ECN::NotECT, source );
+  }
+
+  for ( const GroupReport & report : reports ) {
+    stats_.fec_unrecovered += report.unrecovered;
+
+    ContestMessage ack = parity;
+    ack.transform_into_ack( sequence_number_++, timestamp );
+    ack.header.ack_sequence_number = report.first_sequence_number;
+    ack.payload = report.to_string();
+    send_ack( ack, source );
+  }
+}
 
-    if (message.payload[0] == 'b')
-      continue; /* this is a background packet, ignore it.*/
+void DatagrumpReceiver::got_datagram( const char * const data, const size_t length,
+                                      const uint64_t timestamp, const ECN ecn, const Address & source )
+{
+  const ContestMessage::PacketClass packet_class = ContestMessage::peek_class(data, length);
+  if (packet_class == ContestMessage::PacketClass::CrossTraffic) {
+    stats_.bg_datagrams_received++;
+    return; /* this is a background packet, ignore it without parsing.*/
+  } else if (packet_class == ContestMessage::PacketClass::Parity) {
+    got_parity(data, length, timestamp, source);
+    return;
+  }
+
+  ContestMessage message( data, length );
+  if (fec_) {
+    fec_->remember(message.header.sequence_number, data, length);
+  }
 
+  if (not flow_started_) {
+    /* we got the first of our packets. */
+    tracker_.init(timestamp, true);
+    flow_started_ = true;
+  } else {
     /* Advance timesteps. */
-    tracker.update(PACKET_SIZE_BITS, recd.timestamp);
-    prepare_and_send_ack(message, socket, recd, sequence_number);
+    tracker_.update(PACKET_SIZE_BITS, timestamp);
+  }
+
+  stats_.datagrams_received++;
+  stats_.bytes_received += length;
+  if ( ecn != ECN::NotECT ) {
+    stats_.ect_received++;
+    stats_.ce_received += ecn == ECN::CE;
+  }
+  delays_.add(message.header.send_timestamp, timestamp);
+  if (transfer_) {
+    transfer_->got_chunk(message.payload);
+  }
+  prepare_and_send_ack(message, timestamp, source);
 
+  if (timestamp >= stats_.timestamp + STATS_INTERVAL) {
+    stats_.timestamp = timestamp;
+    stats_.throughput_mbps = bps_to_mpbps(tracker_.get_throughput());
+    delays_.summarize(stats_);
+    stats_segment_.publish(stats_);
+  }
 
+  if (meter_) {
+    meter_->delivered(message.header.ack_payload_length);
+    if (meter_->elapsed_us() >= REPORT_INTERVAL_US) {
+      cout << meter_->report("receiver") << endl;
+      meter_->reset();
+    }
   }
+}
 
-  return EXIT_SUCCESS;
+/* with GRO, one receive can hold several datagrams of segment_size
+   bytes (the last may be shorter); the kernel timestamps the whole
+   coalesced buffer, which serves as each segment's receive time */
+void DatagrumpReceiver::got_datagrams( const char * const data, const size_t length,
+                                       const uint16_t segment_size,
+                                       const uint64_t timestamp, const ECN ecn,
+                                       const Address & source )
+{
+  const size_t step = segment_size ? segment_size : length;
+
+  for ( size_t offset = 0; offset < length; offset += step ) {
+    got_datagram( data + offset, min( step, length - offset ), timestamp, ecn, source );
+  }
+}
+
+/* Loop and acknowledge every incoming datagram back to its source */
+int DatagrumpReceiver::loop()
+{
+  Address source;
+  auto receive = [&] () {
+    const UDPSocket::received_view recd
+      = xdp_ ? xdp_->recv_into( receive_buffer_.data(), receive_buffer_.size(), &source )
+             : socket_.recv_into( receive_buffer_.data(), receive_buffer_.size(), &source );
+    got_datagrams( receive_buffer_.data(), recd.length, recd.segment_size,
+                   recd.timestamp, recd.ecn, source );
+    return ResultType::Continue;
+  };
+
+  /* with only the one socket to read, just block in receive */
+  if ( not uring_ and not bg_sink_ ) {
+    while ( true ) {
+      receive();
+    }
+  }
+
+  Poller poller;
+
+  if ( uring_ ) {
+    /* every waiting completion is handled, then all their acks
+       go out with one submit */
+    poller.add_action( Action( uring_->completion_fd(), Direction::In, [&] () {
+          uring_->process_completions();
+          uring_->submit();
+          return ResultType::Continue;
+        } ) );
+  } else if ( xdp_ ) {
+    poller.add_action( Action( *xdp_, Direction::In, receive ) );
+  } else {
+    poller.add_action( Action( socket_, Direction::In, receive ) );
+  }
+
+  if ( bg_sink_ ) {
+    poller.add_action( Action( *bg_sink_, Direction::In, [&] () {
+          bg_sink_->discard();
+          stats_.bg_datagrams_received++;
+          return ResultType::Continue;
+        } ) );
+  }
+
+  while ( true ) {
+    const auto ret = poller.poll( -1 );
+    if ( ret.result == PollResult::Exit ) {
+      return ret.exit_status;
+    }
+  }
 }
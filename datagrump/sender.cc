@@ -1,36 +1,77 @@
 /* UDP sender for congestion-control contest */
 
 #include <cstdlib>
+#include <cmath>
 #include <iostream>
 #include <stdlib.h> 
 #include <unistd.h>
 #include <sys/types.h>
 #include <string>
 #include <thread>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <getopt.h>
 
 #include "socket.hh"
+#include "uring.hh"
+#include "xdp_socket.hh"
 #include "contest_message.hh"
 #include "controller.hh"
 #include "poller.hh"
 #include "timestamp.hh"
+#include "stats.hh"
+#include "rate_meter.hh"
+#include "transfer.hh"
+#include "fec.hh"
+#include "metrics_cache.hh"
+#include "congestion_manager.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
 #define PACKET_SIZE_BITS (1500 * 8)
+#define PAYLOAD_SIZE_BYTES (1424)
+
+/* optional sender behavior, set from command-line flags */
+struct SenderOptions
+{
+  unsigned int fixed_window = 0; /* if nonzero, bypass the controller with this window */
+  unsigned int duration_s = 0; /* if nonzero, stop after this long and report the packet rate */
+  bool gso = false; /* hand the kernel many datagrams per send, split by UDP GSO */
+  bool uring = false; /* queue sends and receive acks through io_uring */
+  string xdp_interface = ""; /* if set, send and receive through AF_XDP on this interface */
+  string bg_port = ""; /* if set, send cross traffic to this port instead of the flow's */
+  bool compact = false; /* offer the compact header, and use it once the receiver does */
+  string file = ""; /* if set, transfer this file (and stop once it is delivered) */
+  string fec = ""; /* if set, follow datagrams with parity: "xor:K" or "rs:K:M" */
+  string metrics_cache = ""; /* if set, start from (and keep) path metrics in this file */
+  bool congestion_manager = false; /* share one window with the other senders to this receiver */
+  unsigned int cm_weight = 1; /* this flow's weight in the shared window */
+  string ecn = ""; /* if set, send ECN-capable datagrams: "ect0" or "ect1" */
+};
 
 /* simple sender class to handle the accounting */
+template <class ControllerType>
 class DatagrumpSender
 {
 private:
   UDPSocket socket_;
-  Controller controller_; /* your class */
+  ControllerType controller_; /* your class */
+  SenderOptions options_;
+
+  /* every flow datagram is this size, whichever header format it has */
+  static const size_t DATAGRAM_SIZE = ContestMessage::Header::WIRE_SIZE + PAYLOAD_SIZE_BYTES;
+
+  /* ... less room for the FEC framing, when parity is sent */
+  size_t datagram_size_;
 
   useconds_t bg_sender_period_; /* number of microseconds to wait between
                                   background sender injecting a packet.*/
   uint64_t send_time;
   uint64_t toggle_time;
   bool should_send_bg_traffic_;  /* flag indicating if we should send cross traffic. */
+  Address bg_destination_; /* where cross traffic goes */
 
   uint64_t sequence_number_; /* next outgoing sequence number */
 
@@ -39,19 +80,108 @@ private:
      next expects will be acknowledged by the receiver */
   uint64_t next_ack_expected_;
 
+  bool compact_agreed_; /* the receiver has answered in the compact format */
+
+  /* acks are received into this buffer (the socket is connected,
+     so their source is not captured) */
+  static const size_t ACK_BUFFER_SIZE = 65536;
+  std::vector<char> ack_buffer_;
+
+  /* live stats, published to shared memory on every ack */
+  StatsSegment stats_segment_;
+  SenderStats stats_;
+
+  /* loopback benchmark: packet rate, CPU cost and ack-loop latency
+     (only when a duration is given) */
+  static const uint64_t SEND_TIME_SLOTS = 1 << 16;
+  std::unique_ptr<RateMeter> meter_;
+  std::vector<uint64_t> send_time_us_; /* indexed by sequence number modulo slots */
+
+  /* UDP GSO: whole datagrams per send and the buffer they are built in */
+  static const size_t MAX_SEGMENTS = UDPSocket::MAX_GSO_BYTES / DATAGRAM_SIZE < UDPSocket::MAX_GSO_SEGMENTS
+                                     ? UDPSocket::MAX_GSO_BYTES / DATAGRAM_SIZE : UDPSocket::MAX_GSO_SEGMENTS;
+  std::string segments_;
+
+  /* io_uring: datagrams queued per trip around the event loop, all
+     submitted with one syscall */
+  static const unsigned int URING_BATCH = 64;
+  std::unique_ptr<UringUDPSocket> uring_;
+
+  /* AF_XDP: bypass the kernel's UDP stack on one interface */
+  std::unique_ptr<XDPSocket> xdp_;
+
+  /* file transfer: chunks of the file are the payloads */
+  std::unique_ptr<TransferSource> transfer_;
+
+  /* forward error correction: parity after each group of datagrams,
+     and acks handed on in order while the receiver may rebuild a loss */
+  std::unique_ptr<FecEncoder> fec_;
+  std::unique_ptr<AckHoldback> holdback_;
+  AckHoldback::Deliver deliver_;
+
+  /* path metrics kept across runs, stored every METRICS_INTERVAL ms */
+  static const uint64_t METRICS_INTERVAL = 1000;
+  std::unique_ptr<MetricsCache> metrics_cache_;
+  uint64_t metrics_stored_;
+
+  /* shared congestion manager: the window is this flow's share of the
+     macroflow to the receiver, and every in-order ack feeds it */
+  std::unique_ptr<CongestionManager> cm_;
+  uint64_t next_ack_delivered_;
+
+  /* ECN: the receiver's CE count as of the last ack delivered */
+  uint32_t ce_echoed_;
+
+  /* sends our own host refused (the socket is non-blocking), oldest
+     first; nothing new is sent until they have gone out */
+  struct HeldSend
+  {
+    std::string datagrams;
+    uint16_t segment_size; /* nonzero for a GSO buffer */
+  };
+  std::deque<HeldSend> held_;
+
+  std::string make_datagram( const bool after_timeout );
+  void transmit( const std::string & datagram );
+  void send_or_hold( const std::string & datagrams, const uint16_t segment_size );
+  UDPSocket::SendResult try_send( const HeldSend & send );
+  bool send_held();
+  void count_refusal( const UDPSocket::SendResult result );
   void send_datagram( const bool after_timeout );
+  void send_parity( const std::string & payload );
+  void send_segments();
+  unsigned int window_space();
   void inject_bg_packet();
   void got_ack( const uint64_t timestamp, const ContestMessage & msg );
+  void deliver_ack( const AckHoldback::Ack & ack );
+  void got_report( const GroupReport & report );
   bool window_is_open();
   static void toggle_bg_traffig();
+  void publish_stats( const uint64_t timestamp );
+  void store_metrics();
 
 public:
   DatagrumpSender( const char * const host,
           const char * const port, useconds_t bg_sender_period,
-          const bool debug, const bool use_ctcp);
+          const SenderOptions & options );
   int loop();
 };
 
+/* runs a sender with the controller instantiation picked at runtime */
+struct SenderLauncher
+{
+  string host, port;
+  useconds_t bg_sender_period;
+  SenderOptions options;
+
+  template <class ControllerType>
+  int run()
+  {
+    DatagrumpSender<ControllerType> sender( host.c_str(), port.c_str(), bg_sender_period, options );
+    return sender.loop();
+  }
+};
+
 int main( int argc, char *argv[] )
 {
    /* check the command-line arguments */
@@ -59,13 +189,74 @@ int main( int argc, char *argv[] )
     abort();
   }
 
-  bool use_ctcp = true;
+  string controller_name = "ctcp";
   bool debug = false;
   int bg_rate = 10; /* Mbps */
+  SenderOptions options;
+
+  /* flags come first; the positional arguments follow */
+  const char * const program_name = argv[ 0 ];
+  const option flags[] = {
+    { "fixed-window", required_argument, nullptr, 'w' },
+    { "duration",     required_argument, nullptr, 't' },
+    { "gso",          no_argument,       nullptr, 'g' },
+    { "uring",        no_argument,       nullptr, 'u' },
+    { "xdp",          required_argument, nullptr, 'x' },
+    { "bg-port",      required_argument, nullptr, 'b' },
+    { "compact",      no_argument,       nullptr, 'c' },
+    { "file",         required_argument, nullptr, 'f' },
+    { "fec",          required_argument, nullptr, 'e' },
+    { "metrics-cache", required_argument, nullptr, 'm' },
+    { "congestion-manager", no_argument,  nullptr, 'M' },
+    { "cm-weight",    required_argument, nullptr, 'W' },
+    { "ecn",          optional_argument, nullptr, 'E' },
+    { nullptr,        0,                 nullptr, 0 }
+  };
+
+  int flag;
+  while ( (flag = getopt_long( argc, argv, "", flags, nullptr )) != -1 ) {
+    switch ( flag ) {
+    case 'w': options.fixed_window = atoi( optarg ); break;
+    case 't': options.duration_s = atoi( optarg ); break;
+    case 'g': options.gso = true; break;
+    case 'u': options.uring = true; break;
+    case 'x': options.xdp_interface = optarg; break;
+    case 'b': options.bg_port = optarg; break;
+    case 'c': options.compact = true; break;
+    case 'f': options.file = optarg; break;
+    case 'e': options.fec = optarg; break;
+    case 'm': options.metrics_cache = optarg; break;
+    case 'M': options.congestion_manager = true; break;
+    case 'W': options.cm_weight = atoi( optarg ); break;
+    case 'E': options.ecn = optarg ? optarg : "ect0"; break;
+    default: return EXIT_FAILURE;
+    }
+  }
+  if ( not options.xdp_interface.empty() and (options.gso or options.uring) ) {
+    cerr << "--xdp cannot be combined with --gso or --uring" << endl;
+    return EXIT_FAILURE;
+  }
+  if ( not options.file.empty() and options.gso ) {
+    cerr << "--file cannot be combined with --gso (chunk datagrams are not all one size)" << endl;
+    return EXIT_FAILURE;
+  }
+  if ( not options.ecn.empty() and options.ecn != "ect0" and options.ecn != "ect1" ) {
+    cerr << "--ecn takes ect0 or ect1" << endl;
+    return EXIT_FAILURE;
+  }
+  if ( not options.fec.empty() and options.gso ) {
+    cerr << "--fec cannot be combined with --gso (parity datagrams are not all one size)" << endl;
+    return EXIT_FAILURE;
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
 
-  if (argc >= 6 and argv[5][0] == 't') {
+  if (argc >= 6 and is_controller_name(argv[5])) {
+    cerr << "using " << argv[5] << " controller" << endl;
+    controller_name = argv[5];
+  } else if (argc >= 6 and argv[5][0] == 't') {
     cerr << "using tcp instead of ctcp" << endl;
-    use_ctcp = false;
+    controller_name = "tcp";
   }
   if ( argc >= 5 and argv[4][0] == 'd') {
     cerr << "setting debug" << endl;
@@ -76,7 +267,8 @@ int main( int argc, char *argv[] )
   } else if ( argc >= 3 ) {
     /* do nothing */
   } else {
-    cerr << "Usage: " << argv[ 0 ] << " HOST PORT [bgrate] [debug]" << endl;
+    cerr << "Usage: " << program_name
+	 << " [--fixed-window=N] [--duration=SECONDS] [--gso] [--uring] [--xdp=INTERFACE] [--bg-port=PORT] [--compact] [--file=PATH] [--fec=xor:K|rs:K:M] [--metrics-cache=PATH] [--congestion-manager] [--cm-weight=N] [--ecn[=ect0|ect1]] HOST PORT [bgrate] [debug] [tcp|ctcp|ctcp-ld|ctcp-owd]" << endl;
     return EXIT_FAILURE;
   }
   useconds_t bg_sender_period;
@@ -87,22 +279,45 @@ int main( int argc, char *argv[] )
   /* create sender object to handle the accounting */
   /* all the interesting work is done by the Controller */
   cerr << "Startind sender with bg_rate: " << bg_rate << ", debug: " << debug 
-       << ", use_ctcp: " << use_ctcp << endl;
-  DatagrumpSender sender( argv[ 1 ], argv[ 2 ], bg_sender_period, debug, use_ctcp);
-  return sender.loop();
+       << ", controller: " << controller_name << endl;
+  SenderLauncher launcher { argv[ 1 ], argv[ 2 ], bg_sender_period, options };
+  return select_controller( controller_name, debug, launcher );
 }
 
-DatagrumpSender::DatagrumpSender( const char * const host,
+template <class ControllerType>
+DatagrumpSender<ControllerType>::DatagrumpSender( const char * const host,
 				  const char * const port, useconds_t bg_sender_period,
-				  const bool debug, const bool use_ctcp)
+				  const SenderOptions & options )
   : socket_(),
-    controller_( debug, use_ctcp),
+    controller_(),
+    options_( options ),
+    datagram_size_( DATAGRAM_SIZE ),
     bg_sender_period_ ( bg_sender_period ),
     send_time (0),    
     toggle_time (0),
     should_send_bg_traffic_ (false),
+    bg_destination_(),
     sequence_number_( 0 ),
-    next_ack_expected_( 0 )
+    next_ack_expected_( 0 ),
+    compact_agreed_( false ),
+    ack_buffer_( ACK_BUFFER_SIZE ),
+    stats_segment_( StatsSegment::default_name( "sender" ), StatsSegment::Kind::Sender ),
+    stats_(),
+    meter_(),
+    send_time_us_(),
+    segments_(),
+    uring_(),
+    xdp_(),
+    transfer_(),
+    fec_(),
+    holdback_(),
+    deliver_( [this] ( const AckHoldback::Ack & ack ) { deliver_ack( ack ); } ),
+    metrics_cache_(),
+    metrics_stored_( 0 ),
+    cm_(),
+    next_ack_delivered_( 0 ),
+    ce_echoed_( 0 ),
+    held_()
 {
   /* turn on timestamps when socket receives a datagram */
   socket_.set_timestamps();
@@ -112,58 +327,399 @@ DatagrumpSender::DatagrumpSender( const char * const host,
      locally with the remote address */
   socket_.connect( Address( host, port ) );  
 
+  bg_destination_ = options_.bg_port.empty() ? socket_.peer_address()
+                                             : Address( host, options_.bg_port );
+
   cerr << "background send period: " << bg_sender_period_ << " us" << endl;
   cerr << "Sending to " << socket_.peer_address().to_string() << endl;
+  cerr << "Publishing stats to " << stats_segment_.name() << endl;
+
+  if ( options_.fixed_window ) {
+    cerr << "Bypassing controller with fixed window of " << options_.fixed_window << endl;
+  }
+
+  if ( options_.gso ) {
+    segments_.reserve( MAX_SEGMENTS * DATAGRAM_SIZE );
+    cerr << "Sending up to " << MAX_SEGMENTS << " datagrams per send with UDP GSO" << endl;
+  }
+
+  if ( options_.uring ) {
+    uring_.reset( new UringUDPSocket( socket_, [&] ( const UringUDPSocket::received_datagram_view & recd ) {
+	  got_ack( recd.timestamp, ContestMessage( recd.data, recd.length ) );
+	} ) );
+    cerr << "Sending and receiving through io_uring" << endl;
+  }
+
+  if ( not options_.xdp_interface.empty() ) {
+    /* the kernel socket keeps our port reserved and picks the source address */
+    xdp_.reset( new XDPSocket( options_.xdp_interface ) );
+    xdp_->bind( socket_.local_address() );
+    xdp_->connect( socket_.peer_address() );
+    cerr << "Sending and receiving through AF_XDP on " << options_.xdp_interface
+	 << " as " << xdp_->local_address().to_string() << endl;
+  }
+
+  if ( not uring_ and not xdp_ ) {
+    /* sends our own host cannot take yet are held, not waited for */
+    socket_.set_blocking( false );
+    socket_.set_local_errors();
+  }
+
+  if ( not options_.fec.empty() ) {
+    const FecParams params( options_.fec );
+    fec_.reset( new FecEncoder( params ) );
+    holdback_.reset( new AckHoldback( params ) );
+    datagram_size_ -= FecParams::OVERHEAD;
+    cerr << "Sending FEC parity (" << params.to_string() << ", "
+	 << 100.0 * params.parity_count / params.data_count << "% overhead, "
+	 << gf256_kernel_name() << " GF(256) kernel)" << endl;
+  }
+
+  if ( not options_.file.empty() ) {
+    transfer_.reset( new TransferSource( options_.file, datagram_size_ - ContestMessage::Header::WIRE_SIZE
+					                  - ChunkHeader::WIRE_SIZE ) );
+  }
+
+  if ( not options_.metrics_cache.empty() ) {
+    metrics_cache_.reset( new MetricsCache( options_.metrics_cache ) );
+    PathMetrics metrics;
+    if ( metrics_cache_->lookup( socket_.peer_address(), metrics ) ) {
+      controller_.seed( metrics.window, metrics.min_rtt, metrics.loss_window );
+      cerr << "Starting from cached path metrics: window " << metrics.window
+	   << ", min rtt " << metrics.min_rtt << " ms, loss window " << metrics.loss_window << endl;
+    }
+  }
+
+  if ( not options_.ecn.empty() ) {
+    const ECN codepoint = options_.ecn == "ect1" ? ECN::ECT1 : ECN::ECT0;
+    socket_.set_ecn( codepoint );
+    if ( xdp_ ) {
+      xdp_->set_ecn( codepoint );
+    }
+    cerr << "Sending ECN-capable datagrams (" << options_.ecn << ")" << endl;
+  }
+
+  if ( options_.congestion_manager ) {
+    cm_.reset( new CongestionManager( socket_.peer_address(), options_.cm_weight ) );
+    cerr << "Sharing a congestion window through " << cm_->name()
+	 << " with weight " << options_.cm_weight << endl;
+  }
+
+  if ( options_.duration_s ) {
+    meter_.reset( new RateMeter );
+    send_time_us_.resize( SEND_TIME_SLOTS );
+  }
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::publish_stats( const uint64_t timestamp )
+{
+  stats_.timestamp = timestamp;
+  stats_.loss_events = controller_.loss_events();
+  stats_.random_losses = controller_.random_losses();
+  stats_.cwnd = controller_.congestion_window();
+  stats_.dwnd = controller_.delay_window();
+  stats_.rtt = controller_.smoothed_rtt();
+  stats_.base_rtt = controller_.min_rtt();
+  stats_.forward_delay = controller_.forward_delay();
+  stats_.ce_marks = controller_.ce_marks();
+  stats_.ecn_cuts = controller_.ecn_cuts();
+  stats_.ecn_fraction = controller_.ecn_fraction();
+  stats_.clock_skew_ppm = controller_.clock_skew_ppm();
+  if ( cm_ ) {
+    stats_.shared_window = cm_->window();
+    stats_.window_share = cm_->window_share();
+    stats_.shared_loss_events = cm_->loss_events();
+  }
+
+  stats_segment_.publish( stats_ );
+
+  if ( metrics_cache_ and timestamp >= metrics_stored_ + METRICS_INTERVAL ) {
+    store_metrics();
+    metrics_stored_ = timestamp;
+  }
+}
+
+/* remember the path for the next flow: its minimum rtt, the window
+   without the queue it builds (the window scaled by min rtt over rtt),
+   and the window at the last loss */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::store_metrics()
+{
+  if ( isinf( controller_.min_rtt() ) or controller_.smoothed_rtt() <= 0 ) {
+    return; /* nothing measured yet */
+  }
+
+  PathMetrics metrics;
+  metrics.min_rtt = controller_.min_rtt();
+  metrics.window = (controller_.congestion_window() + controller_.delay_window())
+                   * controller_.min_rtt() / controller_.smoothed_rtt();
+  metrics.loss_window = controller_.loss_window();
+  metrics_cache_->store( socket_.peer_address(), metrics );
 }
 
-void DatagrumpSender::got_ack( const uint64_t timestamp,
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::got_ack( const uint64_t timestamp,
 			       const ContestMessage & ack )
 {
   if ( not ack.is_ack() ) {
     throw runtime_error( "sender got something other than an ack from the receiver" );
   }
 
+  if ( options_.compact and not compact_agreed_
+       and ack.header.format == ContestMessage::WireFormat::Compact ) {
+    compact_agreed_ = true;
+    cerr << "Receiver accepted the compact header" << endl;
+  }
+
+  if ( ack.header.packet_class == ContestMessage::PacketClass::Parity ) {
+    got_report( GroupReport( ack.payload ) );
+    return;
+  }
+
   /* Update sender's counter */
   next_ack_expected_ = max( next_ack_expected_,
 			    ack.header.ack_sequence_number + 1 );
 
+  const AckHoldback::Ack received { ack.header.ack_sequence_number,
+                                    ack.header.ack_send_timestamp,
+                                    ack.header.ack_recv_timestamp,
+                                    timestamp, ack.payload,
+                                    ack.header.ack_ce_count };
+  if ( holdback_ ) {
+    holdback_->ack( received, deliver_ );
+  } else {
+    deliver_ack( received );
+  }
+
+  stats_.acks_received++;
+  publish_stats( timestamp );
+
+  if ( meter_ ) {
+    meter_->delivered( ack.header.ack_payload_length );
+    meter_->ack_latency( timestamp_us()
+			 - send_time_us_[ ack.header.ack_sequence_number % SEND_TIME_SLOTS ] );
+  }
+}
+
+/* hand an ack to the transfer and the congestion controller (with FEC,
+   in sequence order once any gap before it is filled or given up on) */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::deliver_ack( const AckHoldback::Ack & ack )
+{
+  if ( transfer_ ) {
+    transfer_->acked( ack.sequence_number, ack.payload );
+  }
+
+  /* marks the receiver saw since the last ack (its count only grows,
+     so an older ack reports none) */
+  const uint32_t ce_marks = ack.ce_count - ce_echoed_;
+  const bool new_marks = ce_marks and ce_marks < (uint32_t( 1 ) << 31);
+  if ( new_marks ) {
+    ce_echoed_ = ack.ce_count;
+  }
+
   /* Inform congestion controller */
-  controller_.ack_received( ack.header.ack_sequence_number,
-			    ack.header.ack_send_timestamp,
-			    ack.header.ack_recv_timestamp,
-			    timestamp );
+  controller_.ack_received( ack.sequence_number,
+			    ack.send_timestamp,
+			    ack.recv_timestamp,
+			    ack.arrival_timestamp,
+			    new_marks ? ce_marks : 0 );
+
+  if ( cm_ and ack.sequence_number >= next_ack_delivered_ ) {
+    cm_->ack_received( ack.arrival_timestamp - ack.send_timestamp,
+		       ack.sequence_number > next_ack_delivered_ );
+    next_ack_delivered_ = ack.sequence_number + 1;
+  }
 }
 
-void DatagrumpSender::send_datagram( const bool after_timeout )
+/* the receiver settled a parity group that lost datagrams */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::got_report( const GroupReport & report )
 {
+  stats_.fec_recovered += report.recovered;
+  stats_.fec_unrecovered += report.unrecovered;
 
-  string dummy_payload = string( 1424, 'c' ); /* ctcp packet */
+  /* rebuilt datagrams are acked like any other; the rest are lost */
+  if ( holdback_ and report.unrecovered ) {
+    holdback_->give_up_before( report.first_sequence_number + report.data_count, deliver_ );
+  }
+}
 
-  ContestMessage cm( sequence_number_++, dummy_payload );
+/* build the next datagram, and account for it as sent */
+template <class ControllerType>
+string DatagrumpSender<ControllerType>::make_datagram( const bool after_timeout )
+{
+  ContestMessage cm( sequence_number_++, "" );
+  cm.header.accepts_compact = options_.compact;
+  if ( compact_agreed_ ) {
+    cm.header.format = ContestMessage::WireFormat::Compact;
+  }
   cm.set_send_timestamp();
-  socket_.send( cm.to_string() );
+  stats_.datagrams_sent++;
+
+  if ( meter_ ) {
+    meter_->sent();
+    send_time_us_[ cm.header.sequence_number % SEND_TIME_SLOTS ] = timestamp_us();
+  }
 
   controller_.datagram_was_sent( cm.header.sequence_number,
 				 cm.header.send_timestamp,
 				 after_timeout );
+
+  const string header = cm.header.to_string();
+  if ( transfer_ ) {
+    return header + transfer_->next_payload( cm.header.sequence_number );
+  }
+
+  /* datagrams are a constant size, so a smaller header carries more payload */
+  return header + string( datagram_size_ - header.size(), 'c' ); /* ctcp packet */
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::transmit( const string & datagram )
+{
+  if ( uring_ ) {
+    uring_->send( datagram );
+  } else if ( xdp_ ) {
+    xdp_->send( datagram );
+  } else {
+    send_or_hold( datagram, 0 );
+  }
+}
+
+template <class ControllerType>
+UDPSocket::SendResult DatagrumpSender<ControllerType>::try_send( const HeldSend & send )
+{
+  return send.segment_size ? socket_.try_send_segments( send.datagrams, send.segment_size )
+                           : socket_.try_send( send.datagrams );
+}
+
+/* a full local queue is not a loss: the datagram waits here, in order,
+   until the socket is writable again */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::send_or_hold( const string & datagrams, const uint16_t segment_size )
+{
+  HeldSend send { datagrams, segment_size };
+  if ( held_.empty() ) {
+    const UDPSocket::SendResult result = try_send( send );
+    if ( result == UDPSocket::SendResult::Sent ) {
+      return;
+    }
+    count_refusal( result );
+  }
+  held_.push_back( move( send ) );
+}
+
+/* retry the held sends; true once they have all gone out */
+template <class ControllerType>
+bool DatagrumpSender<ControllerType>::send_held()
+{
+  while ( not held_.empty() ) {
+    if ( try_send( held_.front() ) != UDPSocket::SendResult::Sent ) {
+      return false;
+    }
+    held_.pop_front();
+  }
+  return true;
 }
 
-void DatagrumpSender::inject_bg_packet() 
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::count_refusal( const UDPSocket::SendResult result )
+{
+  if ( result == UDPSocket::SendResult::SocketFull ) {
+    stats_.local_socket_full++;
+  } else {
+    stats_.local_queue_full++;
+  }
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::send_datagram( const bool after_timeout )
+{
+  const string datagram = make_datagram( after_timeout );
+  transmit( datagram );
+
+  if ( fec_ ) {
+    for ( const string & parity : fec_->add( sequence_number_ - 1, datagram ) ) {
+      send_parity( parity );
+    }
+  }
+}
+
+/* parity is sent outside the window, and never acked itself */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::send_parity( const string & payload )
+{
+  ContestMessage cm( 0, payload ); /* null sequence number */
+  cm.header.packet_class = ContestMessage::PacketClass::Parity;
+  if ( compact_agreed_ ) {
+    cm.header.format = ContestMessage::WireFormat::Compact;
+  }
+  cm.set_send_timestamp();
+  transmit( cm.to_string() );
+  stats_.fec_parity_sent++;
+}
+
+/* fill the open window with one GSO send (each segment is still
+   a separate datagram to the controller and the receiver) */
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::send_segments()
+{
+  const unsigned int count = min( size_t( window_space() ), size_t( MAX_SEGMENTS ) );
+  if ( count == 0 ) {
+    return;
+  }
+
+  segments_.clear();
+  for ( unsigned int i = 0; i < count; i++ ) {
+    segments_ += make_datagram( false );
+  }
+
+  send_or_hold( segments_, DATAGRAM_SIZE );
+}
+
+template <class ControllerType>
+void DatagrumpSender<ControllerType>::inject_bg_packet() 
 {
   string dummy_payload = string( 1424, 'b' ); /* background packet */
   ContestMessage cm( 0, dummy_payload ); /* null sequence number */
+  cm.header.packet_class = ContestMessage::PacketClass::CrossTraffic;
   cm.set_send_timestamp();
   string cm_string =  cm.to_string();
   // cerr << "packet string length: " << cm_string.length() << endl; 
-  socket_.send( cm_string );
+  /* cross traffic is not held: a refused packet is just not sent */
+  const UDPSocket::SendResult result = socket_.try_sendto( bg_destination_, cm_string );
+  if ( result != UDPSocket::SendResult::Sent ) {
+    count_refusal( result );
+    return;
+  }
+  stats_.bg_datagrams_sent++;
 }
 
-bool DatagrumpSender::window_is_open()
+/* how many more datagrams the window allows */
+template <class ControllerType>
+unsigned int DatagrumpSender<ControllerType>::window_space()
 {
-  return sequence_number_ - next_ack_expected_ < controller_.window_size();
+  const unsigned int window = options_.fixed_window ? options_.fixed_window
+                              : cm_ ? cm_->window_share()
+                                    : controller_.window_size();
+  if ( transfer_ and not transfer_->has_data() ) {
+    return 0;
+  }
+
+  const uint64_t outstanding = sequence_number_ - next_ack_expected_;
+  return outstanding < window ? window - outstanding : 0;
 }
 
-int DatagrumpSender::loop()
+template <class ControllerType>
+bool DatagrumpSender<ControllerType>::window_is_open()
+{
+  return window_space() > 0;
+}
+
+template <class ControllerType>
+int DatagrumpSender<ControllerType>::loop()
 {
   /* read and write from the receiver using an event-driven "poller" */
   Poller poller;
@@ -172,27 +728,55 @@ int DatagrumpSender::loop()
      sending more datagrams */
   poller.add_action(
     Action( socket_, Direction::Out, [&] () {
-  	    /* Send if possible */
-        if ( window_is_open() ) {
+  	    /* Send if possible, after anything held */
+        if ( not send_held() ) {
+          return ResultType::Continue;
+        }
+        if ( options_.gso ) {
+          send_segments();
+        } else if ( uring_ ) {
+          /* queue a batch; it goes out with the next submit */
+          for ( unsigned int i = min( window_space(), URING_BATCH ); i > 0; i-- ) {
+            send_datagram( false );
+          }
+        } else if ( window_is_open() ) {
   	     send_datagram( false );
   	    }
 
   	    return ResultType::Continue;
-      }, [&] () { return window_is_open(); } 
+      }, [&] () { return not held_.empty() or window_is_open(); } 
     ) 
   );
 
   /* second rule: if sender receives an ack,
      process it and inform the controller
      (by using the sender's got_ack method) */
-  poller.add_action( 
-    Action( socket_, Direction::In, [&] () {
-      	const UDPSocket::received_datagram recd = socket_.recv();
-      	const ContestMessage ack  = recd.payload;
-      	got_ack( recd.timestamp, ack );
-      	return ResultType::Continue;
-      } )
-  );
+  if ( uring_ ) {
+    /* acks arrive as io_uring completions (handed to got_ack) */
+    poller.add_action(
+      Action( uring_->completion_fd(), Direction::In, [&] () {
+          uring_->process_completions();
+          return ResultType::Continue;
+        } )
+    );
+  } else if ( xdp_ ) {
+    poller.add_action(
+      Action( *xdp_, Direction::In, [&] () {
+          const UDPSocket::received_view recd = xdp_->recv_into( ack_buffer_.data(), ack_buffer_.size() );
+          got_ack( recd.timestamp, ContestMessage( ack_buffer_.data(), recd.length ) );
+          return ResultType::Continue;
+        } )
+    );
+  } else {
+    poller.add_action( 
+      Action( socket_, Direction::In, [&] () {
+        	const UDPSocket::received_view recd = socket_.recv_into( ack_buffer_.data(), ack_buffer_.size() );
+        	const ContestMessage ack( ack_buffer_.data(), recd.length );
+        	got_ack( recd.timestamp, ack );
+        	return ResultType::Continue;
+        } )
+    );
+  }
 
   /* third rule: inject cross-traffic at a constant rate. This busy waits, oh well. */
   if (bg_sender_period_ > 0)
@@ -212,14 +796,43 @@ int DatagrumpSender::loop()
         } ) 
     );
 
-  /* Run these four rules forever */
-  while ( true ) {
+  /* Run these four rules forever (or for the benchmark duration) */
+  while ( not meter_ or meter_->elapsed_us() < options_.duration_s * 1000000ULL ) {
     const auto ret = poller.poll( controller_.timeout_ms() );
     if ( ret.result == PollResult::Exit ) {
       return ret.exit_status;
     } else if ( ret.result == PollResult::Timeout ) {
       /* After a timeout, send one datagram to try to get things moving again */
+      if ( holdback_ ) {
+        holdback_->flush( deliver_ );
+      }
+      if ( transfer_ ) {
+        transfer_->timed_out();
+      }
+      if ( cm_ ) {
+        cm_->timed_out();
+      }
       send_datagram( true );
+      stats_.timeouts++;
+      publish_stats( timestamp_ms() );
+    }
+
+    if ( uring_ ) {
+      uring_->submit();
+    }
+
+    if ( transfer_ and transfer_->complete() ) {
+      cout << transfer_->report() << endl;
+      break;
     }
   }
+
+  if ( meter_ ) {
+    cout << meter_->report( "sender" ) << endl;
+  }
+
+  if ( metrics_cache_ ) {
+    store_metrics();
+  }
+  return EXIT_SUCCESS;
 }
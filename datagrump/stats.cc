@@ -0,0 +1,86 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stats.hh"
+#include "file_descriptor.hh"
+#include "util.hh"
+
+using namespace std;
+
+static const uint32_t STATS_MAGIC = 0x67727570; /* "grup" */
+
+const char * const StatsSegment::directory = "/dev/shm";
+
+/* create (or replace) a segment to publish into */
+StatsSegment::StatsSegment( const string & name, const Kind kind )
+  : name_( name ),
+    owner_( true ),
+    region_(),
+    page_( nullptr )
+{
+  FileDescriptor fd( SystemCall( "shm_open " + name,
+				 shm_open( name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 ) ) );
+  SystemCall( "ftruncate", ftruncate( fd.fd_num(), sizeof( Page ) ) );
+
+  region_.reset( new MMapRegion( sizeof( Page ), PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd_num() ) );
+  page_ = reinterpret_cast<Page *>( region_->addr() );
+
+  /* the segment starts zeroed, so the sequence number is even */
+  page_->kind = kind;
+  page_->pid = getpid();
+  page_->magic = STATS_MAGIC;
+}
+
+/* open an existing segment read-only */
+StatsSegment::StatsSegment( const string & name )
+  : name_( name ),
+    owner_( false ),
+    region_(),
+    page_( nullptr )
+{
+  FileDescriptor fd( SystemCall( "shm_open " + name,
+				 shm_open( name.c_str(), O_RDONLY, 0 ) ) );
+
+  region_.reset( new MMapRegion( sizeof( Page ), PROT_READ, MAP_SHARED, fd.fd_num() ) );
+  page_ = reinterpret_cast<Page *>( region_->addr() );
+
+  if ( page_->magic != STATS_MAGIC ) {
+    throw runtime_error( name + " is not a datagrump stats segment" );
+  }
+}
+
+StatsSegment::~StatsSegment()
+{
+  if ( owner_ ) {
+    try {
+      SystemCall( "shm_unlink", shm_unlink( name_.c_str() ) );
+    } catch ( const exception & e ) { /* don't throw from destructor */
+      print_exception( e );
+    }
+  }
+}
+
+/* name of the segment for this process in the given role */
+string StatsSegment::default_name( const string & role )
+{
+  return "/datagrump-" + role + "-" + to_string( getpid() );
+}
+
+/* seqlock reader: retry until the sequence number is even and unchanged */
+void StatsSegment::read_words( uint64_t * const words, const size_t count ) const
+{
+  while ( true ) {
+    const uint64_t before = page_->sequence.load( memory_order_acquire );
+
+    for ( size_t i = 0; i < count; i++ ) {
+      words[ i ] = page_->words[ i ].load( memory_order_relaxed );
+    }
+
+    atomic_thread_fence( memory_order_acquire );
+    const uint64_t after = page_->sequence.load( memory_order_relaxed );
+
+    if ( before == after and not (before & 1) ) {
+      return;
+    }
+  }
+}
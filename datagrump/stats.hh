@@ -0,0 +1,157 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "mmap_region.hh"
+
+/* live counters and gauges of a running sender */
+struct SenderStats
+{
+  uint64_t timestamp = 0; /* sender's clock, in milliseconds */
+  uint64_t datagrams_sent = 0;
+  uint64_t acks_received = 0;
+  uint64_t timeouts = 0;
+  uint64_t loss_events = 0;
+  uint64_t random_losses = 0; /* gaps the controller took for random loss */
+  uint64_t bg_datagrams_sent = 0;
+  uint64_t fec_parity_sent = 0;
+  uint64_t fec_recovered = 0; /* losses the receiver rebuilt from parity */
+  uint64_t fec_unrecovered = 0; /* losses it could not */
+  uint64_t shared_loss_events = 0; /* halvings of the congestion manager's window */
+  uint64_t ce_marks = 0; /* datagrams the receiver saw marked CE */
+  uint64_t ecn_cuts = 0; /* window reductions for them */
+  uint64_t local_socket_full = 0; /* sends refused by our own socket buffer (EAGAIN) */
+  uint64_t local_queue_full = 0; /* and by the interface queue (ENOBUFS) */
+
+  double cwnd = 0;
+  double dwnd = 0;
+  double rtt = 0; /* smoothed, in milliseconds */
+  double base_rtt = 0; /* minimum seen, in milliseconds */
+  double forward_delay = 0; /* forward queueing delay, in ms (one-way-delay controllers) */
+  double clock_skew_ppm = 0; /* receiver's clock rate relative to ours */
+  double ecn_fraction = 0; /* smoothed fraction of datagrams marked (DCTCP's alpha) */
+  double shared_window = 0; /* congestion manager's aggregate window (0 if not sharing) */
+  double window_share = 0; /* this flow's part of it */
+};
+
+/* live counters and gauges of a running receiver */
+struct ReceiverStats
+{
+  uint64_t timestamp = 0; /* receiver's clock, in milliseconds */
+  uint64_t datagrams_received = 0;
+  uint64_t bytes_received = 0;
+  uint64_t bg_datagrams_received = 0;
+  uint64_t fec_parity_received = 0;
+  uint64_t fec_recovered = 0;
+  uint64_t fec_unrecovered = 0;
+  uint64_t ect_received = 0; /* flow datagrams sent ECN-capable */
+  uint64_t ce_received = 0; /* ... of which a router marked congestion experienced */
+  uint64_t acks_sent = 0;
+
+  double throughput_mbps = 0;
+
+  /* one-way delay above the minimum seen, in milliseconds
+     (the two hosts' clocks are not synchronized) */
+  double delay_p50 = 0;
+  double delay_p95 = 0;
+  double delay_p99 = 0;
+};
+
+/* A POSIX shared-memory segment holding one stats structure,
+   protected by a seqlock. The writer never blocks and never makes
+   a syscall to publish; readers retry until they see a consistent copy. */
+class StatsSegment
+{
+public:
+  enum class Kind : uint32_t { Sender = 1, Receiver = 2 };
+
+  /* largest stats structure, in 64-bit words */
+  static const size_t MAX_WORDS = 32;
+
+private:
+  struct Page
+  {
+    uint32_t magic;
+    Kind kind;
+    uint64_t pid;
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[ MAX_WORDS ];
+  };
+
+  std::string name_;
+  bool owner_; /* unlink the segment on destruction */
+  std::unique_ptr<MMapRegion> region_;
+  Page * page_;
+
+  void write_words( const uint64_t * const words, const size_t count );
+  void read_words( uint64_t * const words, const size_t count ) const;
+
+public:
+  /* create (or replace) a segment to publish into */
+  StatsSegment( const std::string & name, const Kind kind );
+
+  /* open an existing segment read-only */
+  StatsSegment( const std::string & name );
+
+  ~StatsSegment();
+
+  /* name of the segment for this process in the given role */
+  static std::string default_name( const std::string & role );
+
+  /* directory where the segments can be listed */
+  static const char * const directory;
+
+  /* accessors */
+  const std::string & name() const { return name_; }
+  Kind kind() const { return page_->kind; }
+  uint64_t pid() const { return page_->pid; }
+
+  /* publish a new value (writer only) */
+  template <class Stats>
+  void publish( const Stats & stats )
+  {
+    static_assert( sizeof( Stats ) <= MAX_WORDS * sizeof( uint64_t ),
+		   "stats structure too big for segment" );
+    uint64_t words[ MAX_WORDS ];
+    memcpy( words, &stats, sizeof( Stats ) );
+    write_words( words, (sizeof( Stats ) + sizeof( uint64_t ) - 1) / sizeof( uint64_t ) );
+  }
+
+  /* read a consistent snapshot */
+  template <class Stats>
+  Stats read() const
+  {
+    static_assert( sizeof( Stats ) <= MAX_WORDS * sizeof( uint64_t ),
+		   "stats structure too big for segment" );
+    uint64_t words[ MAX_WORDS ];
+    read_words( words, (sizeof( Stats ) + sizeof( uint64_t ) - 1) / sizeof( uint64_t ) );
+    Stats ret;
+    memcpy( &ret, words, sizeof( Stats ) );
+    return ret;
+  }
+
+  /* forbid copying StatsSegment objects or assigning them */
+  StatsSegment( const StatsSegment & other ) = delete;
+  const StatsSegment & operator=( const StatsSegment & other ) = delete;
+};
+
+/* seqlock writer: odd sequence number means an update is in progress */
+inline void StatsSegment::write_words( const uint64_t * const words, const size_t count )
+{
+  const uint64_t sequence = page_->sequence.load( std::memory_order_relaxed );
+  page_->sequence.store( sequence + 1, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_release );
+
+  for ( size_t i = 0; i < count; i++ ) {
+    page_->words[ i ].store( words[ i ], std::memory_order_relaxed );
+  }
+
+  page_->sequence.store( sequence + 2, std::memory_order_release );
+}
+
+#endif /* STATS_HH */
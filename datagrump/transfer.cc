@@ -0,0 +1,342 @@
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/stat.h>
+
+#include "transfer.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+ChunkHeader::ChunkHeader( const uint32_t s_index, const uint32_t s_chunk_size,
+			  const uint64_t s_file_size, const uint64_t s_checksum )
+  : index( s_index ),
+    chunk_size( s_chunk_size ),
+    file_size( s_file_size ),
+    checksum( s_checksum )
+{}
+
+/* Parse header from the start of a payload */
+ChunkHeader::ChunkHeader( const string & payload )
+  : index(), chunk_size(), file_size(), checksum()
+{
+  if ( payload.size() < WIRE_SIZE ) {
+    throw runtime_error( "transfer payload too small to contain chunk header" );
+  }
+
+  memcpy( &index, payload.data(), sizeof( index ) );
+  memcpy( &chunk_size, payload.data() + 4, sizeof( chunk_size ) );
+  memcpy( &file_size, payload.data() + 8, sizeof( file_size ) );
+  memcpy( &checksum, payload.data() + 16, sizeof( checksum ) );
+
+  index = be32toh( index );
+  chunk_size = be32toh( chunk_size );
+  file_size = be64toh( file_size );
+  checksum = be64toh( checksum );
+}
+
+/* Make wire representation of header */
+string ChunkHeader::to_string() const
+{
+  const uint32_t fields32[ 2 ] = { htobe32( index ), htobe32( chunk_size ) };
+  const uint64_t fields64[ 2 ] = { htobe64( file_size ), htobe64( checksum ) };
+
+  char out[ WIRE_SIZE ];
+  memcpy( out, fields32, sizeof( fields32 ) );
+  memcpy( out + sizeof( fields32 ), fields64, sizeof( fields64 ) );
+  return string( out, sizeof( out ) );
+}
+
+/* 64-bit FNV-1a hash of a file's contents */
+uint64_t transfer_checksum( const uint8_t * const data, const size_t length )
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for ( size_t i = 0; i < length; i++ ) {
+    hash = (hash ^ data[ i ]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t file_size( const FileDescriptor & file )
+{
+  struct stat info;
+  SystemCall( "fstat", fstat( file.fd_num(), &info ) );
+  if ( info.st_size == 0 ) {
+    throw runtime_error( "cannot transfer an empty file" );
+  }
+  return info.st_size;
+}
+
+TransferSource::TransferSource( const string & path, const uint32_t chunk_size )
+  : file_( SystemCall( "open " + path, open( path.c_str(), O_RDONLY ) ) ),
+    size_( file_size( file_ ) ),
+    data_( size_, PROT_READ, MAP_SHARED, file_.fd_num() ),
+    chunk_size_( chunk_size ),
+    chunk_count_( (size_ + chunk_size - 1) / chunk_size ),
+    checksum_( transfer_checksum( data_.addr(), size_ ) ),
+    chunk_acked_( chunk_count_ ),
+    chunks_acked_( 0 ),
+    first_unacked_( 0 ),
+    next_new_chunk_( 0 ),
+    retransmit_queue_(),
+    retransmissions_( 0 ),
+    chunk_of_sequence_( SEQUENCE_SLOTS, NO_CHUNK ),
+    lowest_outstanding_( 0 ),
+    next_sequence_number_( 0 ),
+    start_us_( 0 ),
+    finish_us_( 0 )
+{
+  if ( chunk_count_ > UINT32_MAX ) {
+    throw runtime_error( "file too large to transfer" );
+  }
+
+  /* the file is read front to back */
+  madvise( data_.addr(), size_, MADV_SEQUENTIAL );
+
+  cerr << "Transferring " << path << ": " << size_ << " bytes in "
+       << chunk_count_ << " chunks of " << chunk_size_ << endl;
+}
+
+/* is there a chunk waiting to be sent or resent? */
+bool TransferSource::has_data() const
+{
+  return next_new_chunk_ < chunk_count_ or not retransmit_queue_.empty();
+}
+
+/* the payload for this datagram: a lost chunk, else the next new one */
+string TransferSource::next_payload( const uint64_t sequence_number )
+{
+  if ( start_us_ == 0 ) {
+    start_us_ = timestamp_us();
+  }
+
+  while ( not retransmit_queue_.empty() and chunk_acked_[ retransmit_queue_.front() ] ) {
+    retransmit_queue_.pop_front();
+  }
+
+  uint64_t chunk;
+  if ( not retransmit_queue_.empty() ) {
+    chunk = retransmit_queue_.front();
+    retransmit_queue_.pop_front();
+    retransmissions_++;
+  } else if ( next_new_chunk_ < chunk_count_ ) {
+    chunk = next_new_chunk_++;
+  } else {
+    /* nothing known lost: probe with the first chunk not yet acked */
+    chunk = first_unacked_ < chunk_count_ ? first_unacked_ : 0;
+    retransmissions_++;
+  }
+
+  /* datagrams older than the tracking window are forgotten (and resent
+     after a timeout if they were lost) */
+  if ( sequence_number >= lowest_outstanding_ + SEQUENCE_SLOTS ) {
+    lowest_outstanding_ = sequence_number - SEQUENCE_SLOTS + 1;
+  }
+  chunk_of_sequence_[ sequence_number % SEQUENCE_SLOTS ] = chunk;
+  next_sequence_number_ = sequence_number + 1;
+
+  const uint64_t offset = chunk * chunk_size_;
+  const size_t length = min( uint64_t( chunk_size_ ), size_ - offset );
+
+  return ChunkHeader( chunk, chunk_size_, size_, checksum_ ).to_string()
+    + string( reinterpret_cast<const char *>( data_.addr() + offset ), length );
+}
+
+void TransferSource::mark_acked( const uint64_t chunk )
+{
+  if ( chunk >= chunk_count_ or chunk_acked_[ chunk ] ) {
+    return;
+  }
+
+  chunk_acked_[ chunk ] = true;
+  chunks_acked_++;
+
+  while ( first_unacked_ < chunk_count_ and chunk_acked_[ first_unacked_ ] ) {
+    first_unacked_++;
+  }
+
+  if ( complete() ) {
+    finish_us_ = timestamp_us();
+  }
+}
+
+void TransferSource::mark_lost( const uint64_t chunk )
+{
+  if ( not chunk_acked_[ chunk ] ) {
+    retransmit_queue_.push_back( chunk );
+  }
+}
+
+/* a datagram was acked; the ack's payload has the receiver's in-order count */
+void TransferSource::acked( const uint64_t sequence_number, const string & ack_payload )
+{
+  if ( ack_payload.size() >= sizeof( uint64_t ) ) {
+    uint64_t in_order;
+    memcpy( &in_order, ack_payload.data(), sizeof( in_order ) );
+    in_order = min( be64toh( in_order ), chunk_count_ );
+    while ( first_unacked_ < in_order ) {
+      mark_acked( first_unacked_ );
+    }
+  }
+
+  if ( sequence_number < lowest_outstanding_ or sequence_number >= next_sequence_number_ ) {
+    return;
+  }
+
+  uint64_t & slot = chunk_of_sequence_[ sequence_number % SEQUENCE_SLOTS ];
+  if ( slot != NO_CHUNK ) {
+    mark_acked( slot );
+    slot = NO_CHUNK;
+  }
+
+  /* an outstanding datagram is lost once one sent REORDER_THRESHOLD
+     later has been acked */
+  while ( lowest_outstanding_ < next_sequence_number_ ) {
+    uint64_t & oldest = chunk_of_sequence_[ lowest_outstanding_ % SEQUENCE_SLOTS ];
+    if ( oldest != NO_CHUNK ) {
+      if ( lowest_outstanding_ + REORDER_THRESHOLD > sequence_number ) {
+	break;
+      }
+      mark_lost( oldest );
+      oldest = NO_CHUNK;
+    }
+    lowest_outstanding_++;
+  }
+}
+
+/* no acks for a while: consider every outstanding datagram lost */
+void TransferSource::timed_out()
+{
+  for ( ; lowest_outstanding_ < next_sequence_number_; lowest_outstanding_++ ) {
+    uint64_t & slot = chunk_of_sequence_[ lowest_outstanding_ % SEQUENCE_SLOTS ];
+    if ( slot != NO_CHUNK ) {
+      mark_lost( slot );
+      slot = NO_CHUNK;
+    }
+  }
+}
+
+/* one-line summary of the transfer */
+string TransferSource::report() const
+{
+  const double seconds = (finish_us_ - start_us_) / 1e6;
+
+  ostringstream out;
+  out << fixed << setprecision( 2 )
+      << "transfer: " << size_ << " bytes in " << seconds << " s, goodput "
+      << size_ * 8 / seconds / 1e6 << " Mbps, "
+      << retransmissions_ << " chunks resent (" << 100.0 * retransmissions_ / chunk_count_ << "%)";
+  return out.str();
+}
+
+TransferSink::TransferSink( const string & path )
+  : path_( path ),
+    file_( SystemCall( "open " + path, open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 ) ) ),
+    data_(),
+    size_( 0 ),
+    chunk_size_( 0 ),
+    chunk_count_( 0 ),
+    checksum_( 0 ),
+    received_(),
+    chunks_received_( 0 ),
+    in_order_( 0 ),
+    duplicates_( 0 ),
+    start_us_( 0 ),
+    complete_( false )
+{
+  cerr << "Writing transfer to " << path_ << endl;
+}
+
+/* size and map the output file for the transfer the first chunk describes */
+void TransferSink::start( const ChunkHeader & header )
+{
+  if ( header.file_size == 0 or header.chunk_size == 0 ) {
+    throw runtime_error( "transfer chunk describes an empty file" );
+  }
+
+  size_ = header.file_size;
+  chunk_size_ = header.chunk_size;
+  chunk_count_ = (size_ + chunk_size_ - 1) / chunk_size_;
+  checksum_ = header.checksum;
+  received_.resize( chunk_count_ );
+  start_us_ = timestamp_us();
+
+  /* reserve the blocks up front, so writes never fail for lack of space */
+  const int ret = posix_fallocate( file_.fd_num(), 0, size_ );
+  if ( ret ) {
+    throw unix_error( "posix_fallocate " + path_, ret );
+  }
+
+  data_.reset( new MMapRegion( size_, PROT_READ | PROT_WRITE, MAP_SHARED, file_.fd_num() ) );
+
+  cerr << "Receiving " << size_ << " bytes in " << chunk_count_ << " chunks" << endl;
+}
+
+/* a flow datagram's payload arrived */
+void TransferSink::got_chunk( const string & payload )
+{
+  const ChunkHeader header( payload );
+
+  if ( not data_ ) {
+    start( header );
+  } else if ( header.file_size != size_ or header.chunk_size != chunk_size_
+	      or header.checksum != checksum_ ) {
+    throw runtime_error( "transfer chunk belongs to a different transfer" );
+  }
+
+  const uint64_t offset = uint64_t( header.index ) * chunk_size_;
+  const size_t length = payload.size() - ChunkHeader::WIRE_SIZE;
+  if ( header.index >= chunk_count_ or length != min( uint64_t( chunk_size_ ), size_ - offset ) ) {
+    throw runtime_error( "transfer chunk out of range" );
+  }
+
+  if ( received_[ header.index ] ) {
+    duplicates_++;
+    return;
+  }
+
+  memcpy( data_->addr() + offset, payload.data() + ChunkHeader::WIRE_SIZE, length );
+  received_[ header.index ] = true;
+  chunks_received_++;
+
+  while ( in_order_ < chunk_count_ and received_[ in_order_ ] ) {
+    in_order_++;
+  }
+
+  if ( chunks_received_ == chunk_count_ and not complete_ ) {
+    finish();
+  }
+}
+
+/* flush the file and check it against the sender's checksum */
+void TransferSink::finish()
+{
+  complete_ = true;
+  const double seconds = (timestamp_us() - start_us_) / 1e6;
+
+  SystemCall( "msync", msync( data_->addr(), size_, MS_SYNC ) );
+  const bool verified = transfer_checksum( data_->addr(), size_ ) == checksum_;
+
+  cerr << fixed << setprecision( 2 )
+       << "transfer complete: " << size_ << " bytes in " << seconds << " s ("
+       << size_ * 8 / seconds / 1e6 << " Mbps), " << duplicates_ << " duplicate chunks, checksum "
+       << (verified ? "verified" : "MISMATCH") << endl;
+
+  if ( not verified ) {
+    throw runtime_error( "transfer checksum mismatch in " + path_ );
+  }
+}
+
+/* payload for acks: the number of chunks held in order */
+string TransferSink::ack_payload() const
+{
+  const uint64_t network_order = htobe64( in_order_ );
+  return string( reinterpret_cast<const char *>( &network_order ), sizeof( network_order ) );
+}
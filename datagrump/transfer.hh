@@ -0,0 +1,121 @@
+#ifndef TRANSFER_HH
+#define TRANSFER_HH
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+
+/* File transfer mode: the file is cut into fixed-size chunks, and each
+   flow datagram's payload is one chunk after this header. Acks carry the
+   receiver's count of chunks it holds in order. */
+struct ChunkHeader
+{
+  uint32_t index;
+  uint32_t chunk_size; /* every chunk but the last is this long */
+  uint64_t file_size;
+  uint64_t checksum; /* of the whole file */
+
+  static const size_t WIRE_SIZE = 2 * sizeof( uint32_t ) + 2 * sizeof( uint64_t );
+
+  ChunkHeader( const uint32_t s_index, const uint32_t s_chunk_size,
+	       const uint64_t s_file_size, const uint64_t s_checksum );
+
+  /* Parse header from the start of a payload */
+  ChunkHeader( const std::string & payload );
+
+  /* Make wire representation of header */
+  std::string to_string() const;
+};
+
+/* 64-bit FNV-1a hash of a file's contents */
+uint64_t transfer_checksum( const uint8_t * const data, const size_t length );
+
+/* sender side: picks the chunk for each datagram, and retransmits chunks
+   whose datagrams were lost */
+class TransferSource
+{
+private:
+  static const uint64_t NO_CHUNK = -1;
+  static const uint64_t SEQUENCE_SLOTS = 1 << 16; /* most datagrams tracked in flight */
+  static const uint64_t REORDER_THRESHOLD = 3; /* later datagrams acked before one is lost */
+
+  FileDescriptor file_;
+  uint64_t size_;
+  MMapRegion data_;
+  uint32_t chunk_size_;
+  uint64_t chunk_count_, checksum_;
+
+  std::vector<bool> chunk_acked_;
+  uint64_t chunks_acked_, first_unacked_;
+
+  uint64_t next_new_chunk_;
+  std::deque<uint64_t> retransmit_queue_;
+  uint64_t retransmissions_;
+
+  /* chunk carried by each outstanding datagram, by sequence number modulo slots */
+  std::vector<uint64_t> chunk_of_sequence_;
+  uint64_t lowest_outstanding_, next_sequence_number_;
+
+  uint64_t start_us_, finish_us_;
+
+  void mark_acked( const uint64_t chunk );
+  void mark_lost( const uint64_t chunk );
+
+public:
+  TransferSource( const std::string & path, const uint32_t chunk_size );
+
+  /* is there a chunk waiting to be sent or resent? */
+  bool has_data() const;
+
+  /* the payload for this datagram: a lost chunk, else the next new one */
+  std::string next_payload( const uint64_t sequence_number );
+
+  /* a datagram was acked; the ack's payload has the receiver's in-order count */
+  void acked( const uint64_t sequence_number, const std::string & ack_payload );
+
+  /* no acks for a while: consider every outstanding datagram lost */
+  void timed_out();
+
+  /* has every chunk been acked? */
+  bool complete() const { return chunks_acked_ == chunk_count_; }
+
+  /* one-line summary of the transfer */
+  std::string report() const;
+};
+
+/* receiver side: writes chunks into place in a preallocated, memory-mapped
+   output file, and verifies the whole file when the last one arrives */
+class TransferSink
+{
+private:
+  std::string path_;
+  FileDescriptor file_;
+  std::unique_ptr<MMapRegion> data_; /* mapped once the first chunk gives the size */
+
+  uint64_t size_, chunk_size_, chunk_count_, checksum_;
+  std::vector<bool> received_;
+  uint64_t chunks_received_, in_order_, duplicates_;
+  uint64_t start_us_;
+  bool complete_;
+
+  void start( const ChunkHeader & header );
+  void finish();
+
+public:
+  TransferSink( const std::string & path );
+
+  /* a flow datagram's payload arrived */
+  void got_chunk( const std::string & payload );
+
+  /* payload for acks: the number of chunks held in order */
+  std::string ack_payload() const;
+
+  bool complete() const { return complete_; }
+};
+
+#endif /* TRANSFER_HH */
@@ -0,0 +1,65 @@
+#include <ctime>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "cpu_counter.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* open a cycle counter for the calling thread, or return -1 */
+static int open_cycle_counter( const bool include_kernel )
+{
+  perf_event_attr attr;
+  zero( attr );
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof( attr );
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_kernel = not include_kernel;
+  attr.exclude_hv = true;
+
+  return syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+CPUCounter::CPUCounter()
+  : perf_event_(),
+    includes_kernel_( true )
+{
+  /* kernel cycles need perf_event_paranoid <= 1, so fall back to user only */
+  int fd = open_cycle_counter( true );
+  if ( fd < 0 ) {
+    includes_kernel_ = false;
+    fd = open_cycle_counter( false );
+  }
+
+  if ( fd >= 0 ) {
+    perf_event_.reset( new FileDescriptor( fd ) );
+  }
+}
+
+uint64_t CPUCounter::read() const
+{
+  if ( perf_event_ ) {
+    uint64_t count;
+    if ( SystemCall( "read", ::read( perf_event_->fd_num(), &count, sizeof( count ) ) )
+	 != sizeof( count ) ) {
+      throw runtime_error( "short read from perf event" );
+    }
+    return count;
+  }
+
+  timespec ts;
+  SystemCall( "clock_gettime", clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) );
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+const char * CPUCounter::unit() const
+{
+  if ( not perf_event_ ) {
+    return "cpu-ns";
+  }
+
+  return includes_kernel_ ? "cycles" : "user-cycles";
+}
@@ -0,0 +1,28 @@
+#ifndef CPU_COUNTER_HH
+#define CPU_COUNTER_HH
+
+#include <cstdint>
+#include <memory>
+
+#include "file_descriptor.hh"
+
+/* CPU consumed by the calling thread: hardware cycles (user and, if
+   permitted, kernel) when perf events are available, otherwise CPU time
+   in nanoseconds */
+class CPUCounter
+{
+private:
+  std::unique_ptr<FileDescriptor> perf_event_;
+  bool includes_kernel_;
+
+public:
+  CPUCounter();
+
+  /* current count */
+  uint64_t read() const;
+
+  /* what the count measures */
+  const char * unit() const;
+};
+
+#endif /* CPU_COUNTER_HH */
@@ -1,6 +1,7 @@
 #include "file_descriptor.hh"
 #include "util.hh"
 
+#include <fcntl.h>
 #include <unistd.h>
 
 using namespace std;
@@ -38,6 +39,13 @@ FileDescriptor::~FileDescriptor()
   }
 }
 
+/* make reads and writes wait (or fail with EAGAIN instead) */
+void FileDescriptor::set_blocking( const bool blocking )
+{
+  const int flags = SystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
+  SystemCall( "fcntl F_SETFL", fcntl( fd_, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK ) );
+}
+
 /* attempt to write a portion of a string */
 string::const_iterator FileDescriptor::write( const string::const_iterator & begin,
 					      const string::const_iterator & end )
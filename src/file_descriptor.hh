@@ -40,6 +40,9 @@ public:
   unsigned int read_count() const { return read_count_; }
   unsigned int write_count() const { return write_count_; }
 
+  /* make reads and writes wait (or fail with EAGAIN instead) */
+  void set_blocking( const bool blocking );
+
   /* read and write methods */
   std::string read( const size_t limit = BUFFER_SIZE );
   std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
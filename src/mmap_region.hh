@@ -0,0 +1,36 @@
+#ifndef MMAP_REGION_HH
+#define MMAP_REGION_HH
+
+#include <cstdint>
+#include <cstddef>
+
+#include <sys/mman.h>
+
+/* a memory mapping (of a file, shared-memory object, or anonymous memory) */
+class MMapRegion
+{
+private:
+  uint8_t * addr_;
+  size_t length_;
+
+public:
+  /* map length bytes of fd (or anonymous memory if fd is -1) */
+  MMapRegion( const size_t length, const int prot, const int flags,
+	      const int fd = -1, const off_t offset = 0 );
+
+  /* move constructor */
+  MMapRegion( MMapRegion && other );
+
+  /* destructor */
+  ~MMapRegion();
+
+  /* accessors */
+  uint8_t * addr() const { return addr_; }
+  size_t length() const { return length_; }
+
+  /* forbid copying MMapRegion objects or assigning them */
+  MMapRegion( const MMapRegion & other ) = delete;
+  const MMapRegion & operator=( const MMapRegion & other ) = delete;
+};
+
+#endif /* MMAP_REGION_HH */
@@ -1,4 +1,6 @@
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 
 #include "socket.hh"
 #include "util.hh"
@@ -79,22 +81,35 @@ void Socket::connect( const Address & address )
 UDPSocket::received_datagram UDPSocket::recv()
 {
   static const ssize_t RECEIVE_MTU = 65536;
+  char msg_payload[ RECEIVE_MTU ];
+
+  Address source;
+  const received_view recd = recv_into( msg_payload, sizeof( msg_payload ), &source );
+
+  return { source, recd.timestamp, string( msg_payload, recd.length ), recd.segment_size, recd.ecn };
+}
+
+/* receive a datagram into the caller's buffer */
+UDPSocket::received_view UDPSocket::recv_into( char * const buffer, const size_t capacity,
+					       Address * const source )
+{
+  /* room for the three control messages we ask for */
+  static const size_t CONTROL_SIZE = CMSG_SPACE( sizeof( timespec ) ) + 2 * CMSG_SPACE( sizeof( int ) );
 
-  /* receive source address, timestamp and payload */
   Address::raw datagram_source_address;
   msghdr header; zero( header );
   iovec msg_iovec; zero( msg_iovec );
-
-  char msg_payload[ RECEIVE_MTU ];
-  char msg_control[ RECEIVE_MTU ];
+  alignas( cmsghdr ) char msg_control[ CONTROL_SIZE ];
 
   /* prepare to get the source address */
-  header.msg_name = &datagram_source_address;
-  header.msg_namelen = sizeof( datagram_source_address );
+  if ( source ) {
+    header.msg_name = &datagram_source_address;
+    header.msg_namelen = sizeof( datagram_source_address );
+  }
 
   /* prepare to get the payload */
-  msg_iovec.iov_base = msg_payload;
-  msg_iovec.iov_len = sizeof( msg_payload );
+  msg_iovec.iov_base = buffer;
+  msg_iovec.iov_len = capacity;
   header.msg_iov = &msg_iovec;
   header.msg_iovlen = 1;
 
@@ -116,57 +131,148 @@ UDPSocket::received_datagram UDPSocket::recv()
   }
 
   uint64_t timestamp = -1;
+  int segment_size = 0;
+  ECN ecn = ECN::NotECT;
 
-  /* find the timestamp header (if there is one) */
+  /* find the timestamp, GRO segment size and TOS headers (if there are any) */
   cmsghdr *ts_hdr = CMSG_FIRSTHDR( &header );
   while ( ts_hdr ) {
     if ( ts_hdr->cmsg_level == SOL_SOCKET
 	 and ts_hdr->cmsg_type == SO_TIMESTAMPNS ) {
-      const timespec * const kernel_time = reinterpret_cast<timespec *>( CMSG_DATA( ts_hdr ) );
-      timestamp = timestamp_ms( *kernel_time );
+      timespec kernel_time;
+      memcpy( &kernel_time, CMSG_DATA( ts_hdr ), sizeof( kernel_time ) );
+      timestamp = timestamp_ms( kernel_time );
+    } else if ( ts_hdr->cmsg_level == SOL_UDP
+		and ts_hdr->cmsg_type == UDP_GRO ) {
+      memcpy( &segment_size, CMSG_DATA( ts_hdr ), sizeof( segment_size ) );
+    } else {
+      ecn = received_ecn( *ts_hdr, ecn );
     }
     ts_hdr = CMSG_NXTHDR( &header, ts_hdr );
   }
 
-  received_datagram ret = { Address( datagram_source_address,
-				     header.msg_namelen ),
-			    timestamp,
-			    string( msg_payload, recv_len ) };
+  if ( source ) {
+    *source = Address( datagram_source_address, header.msg_namelen );
+  }
 
-  return ret;
+  return { size_t( recv_len ), timestamp, uint16_t( segment_size ), ecn };
+}
+
+/* drop the next datagram without copying it out */
+size_t UDPSocket::discard()
+{
+  const ssize_t length = SystemCall( "recv (discard)", ::recv( fd_num(), nullptr, 0, MSG_TRUNC ) );
+
+  register_read();
+
+  return length;
+}
+
+/* what a send came to: a full local queue is reported, other errors thrown */
+static UDPSocket::SendResult send_result( const char * const attempt, const ssize_t bytes_sent,
+					  const size_t expected )
+{
+  if ( bytes_sent < 0 ) {
+    if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+      return UDPSocket::SendResult::SocketFull;
+    }
+    if ( errno == ENOBUFS ) {
+      return UDPSocket::SendResult::QueueFull;
+    }
+    throw unix_error( attempt );
+  }
+
+  if ( size_t( bytes_sent ) != expected ) {
+    throw runtime_error( "datagram too big for " + string( attempt ) );
+  }
+
+  return UDPSocket::SendResult::Sent;
 }
 
 /* send datagram to specified address */
-void UDPSocket::sendto( const Address & destination, const string & payload )
+UDPSocket::SendResult UDPSocket::try_sendto( const Address & destination, const string & payload )
 {
-  const ssize_t bytes_sent =
-    SystemCall( "sendto", ::sendto( fd_num(),
-				    payload.data(),
-				    payload.size(),
-				    0,
-				    &destination.to_sockaddr(),
-				    destination.size() ) );
+  const SendResult result =
+    send_result( "sendto", ::sendto( fd_num(),
+				     payload.data(),
+				     payload.size(),
+				     0,
+				     &destination.to_sockaddr(),
+				     destination.size() ),
+		 payload.size() );
 
   register_write();
 
-  if ( size_t( bytes_sent ) != payload.size() ) {
-    throw runtime_error( "datagram payload too big for sendto()" );
+  return result;
+}
+
+void UDPSocket::sendto( const Address & destination, const string & payload )
+{
+  if ( try_sendto( destination, payload ) != SendResult::Sent ) {
+    throw unix_error( "sendto" );
   }
 }
 
 /* send datagram to connected address */
+UDPSocket::SendResult UDPSocket::try_send( const string & payload )
+{
+  const SendResult result =
+    send_result( "send", ::send( fd_num(),
+				 payload.data(),
+				 payload.size(),
+				 0 ),
+		 payload.size() );
+
+  register_write();
+
+  return result;
+}
+
 void UDPSocket::send( const string & payload )
 {
-  const ssize_t bytes_sent =
-    SystemCall( "send", ::send( fd_num(),
-				payload.data(),
-				payload.size(),
-				0 ) );
+  if ( try_send( payload ) != SendResult::Sent ) {
+    throw unix_error( "send" );
+  }
+}
+
+/* send a buffer of back-to-back datagrams to the connected address in one
+   call, letting the kernel split it every segment_size bytes (UDP GSO) */
+UDPSocket::SendResult UDPSocket::try_send_segments( const string & buffer, const uint16_t segment_size )
+{
+  msghdr header; zero( header );
+  iovec msg_iovec; zero( msg_iovec );
+
+  /* the payload */
+  msg_iovec.iov_base = const_cast<char *>( buffer.data() );
+  msg_iovec.iov_len = buffer.size();
+  header.msg_iov = &msg_iovec;
+  header.msg_iovlen = 1;
+
+  /* the segment size */
+  char msg_control[ CMSG_SPACE( sizeof( uint16_t ) ) ];
+  zero( msg_control );
+  header.msg_control = msg_control;
+  header.msg_controllen = sizeof( msg_control );
+
+  cmsghdr * const segment_hdr = CMSG_FIRSTHDR( &header );
+  segment_hdr->cmsg_level = SOL_UDP;
+  segment_hdr->cmsg_type = UDP_SEGMENT;
+  segment_hdr->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+  memcpy( CMSG_DATA( segment_hdr ), &segment_size, sizeof( uint16_t ) );
+
+  const SendResult result = send_result( "sendmsg (UDP_SEGMENT)",
+					 sendmsg( fd_num(), &header, 0 ),
+					 buffer.size() );
 
   register_write();
 
-  if ( size_t( bytes_sent ) != payload.size() ) {
-    throw runtime_error( "datagram payload too big for send()" );
+  return result;
+}
+
+void UDPSocket::send_segments( const string & buffer, const uint16_t segment_size )
+{
+  if ( try_send_segments( buffer, segment_size ) != SendResult::Sent ) {
+    throw unix_error( "sendmsg (UDP_SEGMENT)" );
   }
 }
 
@@ -202,3 +308,46 @@ void UDPSocket::set_timestamps()
 {
   setsockopt( SOL_SOCKET, SO_TIMESTAMPNS, int( true ) );
 }
+
+/* let the kernel coalesce consecutive datagrams into one receive (UDP GRO) */
+void UDPSocket::set_gro()
+{
+  setsockopt( SOL_UDP, UDP_GRO, int( true ) );
+}
+
+/* mark outgoing datagrams with this ECN codepoint (the socket is IPv6,
+   but sends to IPv4-mapped addresses take the IPv4 TOS) */
+void UDPSocket::set_ecn( const ECN codepoint )
+{
+  setsockopt( IPPROTO_IPV6, IPV6_TCLASS, int( codepoint ) );
+  setsockopt( IPPROTO_IP, IP_TOS, int( codepoint ) );
+}
+
+/* report the ECN codepoint of each received datagram */
+void UDPSocket::set_receive_ecn()
+{
+  setsockopt( IPPROTO_IPV6, IPV6_RECVTCLASS, int( true ) );
+  setsockopt( IPPROTO_IP, IP_RECVTOS, int( true ) );
+}
+
+/* without IP_RECVERR, Linux counts a datagram the interface queue
+   refused as sent; with it, the send fails with ENOBUFS */
+void UDPSocket::set_local_errors()
+{
+  setsockopt( IPPROTO_IPV6, IPV6_RECVERR, int( true ) );
+  setsockopt( IPPROTO_IP, IP_RECVERR, int( true ) );
+}
+
+/* the ECN codepoint in a received TOS or traffic class control message
+   (or the one found so far, if this is some other message) */
+ECN received_ecn( const cmsghdr & header, const ECN ecn )
+{
+  if ( header.cmsg_level == IPPROTO_IP and header.cmsg_type == IP_TOS ) {
+    return ECN( *CMSG_DATA( &header ) & 0x03 );
+  } else if ( header.cmsg_level == IPPROTO_IPV6 and header.cmsg_type == IPV6_TCLASS ) {
+    int traffic_class;
+    memcpy( &traffic_class, CMSG_DATA( &header ), sizeof( traffic_class ) );
+    return ECN( traffic_class & 0x03 );
+  }
+  return ecn;
+}
@@ -3,6 +3,8 @@
 
 #include <functional>
 
+#include <sys/socket.h>
+
 #include "address.hh"
 #include "file_descriptor.hh"
 
@@ -40,6 +42,14 @@ public:
   void set_reuseaddr();
 };
 
+/* the ECN codepoint: the low two bits of the IPv4 TOS byte or the IPv6
+   traffic class (RFC 3168) */
+enum class ECN : uint8_t { NotECT = 0, ECT1 = 1, ECT0 = 2, CE = 3 };
+
+/* the ECN codepoint in a received TOS or traffic class control message
+   (or the one found so far, if this is some other message) */
+ECN received_ecn( const cmsghdr & header, const ECN ecn );
+
 /* UDP socket */
 class UDPSocket : public Socket
 {
@@ -50,19 +60,72 @@ public:
     Address source_address;
     uint64_t timestamp;
     std::string payload;
+    uint16_t segment_size; /* if nonzero, payload holds several datagrams of this size (GRO) */
+    ECN ecn; /* NotECT unless set_receive_ecn() was called */
   };
 
   /* receive datagram, timestamp, and where it came from */
   received_datagram recv();
 
+  /* what recv_into() wrote to the caller's buffer */
+  struct received_view {
+    size_t length;
+    uint64_t timestamp;
+    uint16_t segment_size; /* if nonzero, the buffer holds several datagrams of this size (GRO) */
+    ECN ecn; /* NotECT unless set_receive_ecn() was called */
+  };
+
+  /* receive a datagram into the caller's buffer (which should hold the
+     largest expected datagram, or 64 KiB with GRO), recording where it
+     came from only if source is given */
+  received_view recv_into( char * const buffer, const size_t capacity,
+			   Address * const source = nullptr );
+
+  /* drop the next datagram without copying it out; returns its length */
+  size_t discard();
+
   /* send datagram to specified address */
   void sendto( const Address & peer, const std::string & payload );
 
   /* send datagram to connected address */
   void send( const std::string & payload );
 
+  /* send a buffer of back-to-back datagrams to the connected address in one
+     call, letting the kernel split it every segment_size bytes (UDP GSO) */
+  void send_segments( const std::string & buffer, const uint16_t segment_size );
+
+  /* what became of a send on a non-blocking socket: nothing is sent
+     unless it is Sent */
+  enum class SendResult {
+    Sent,
+    SocketFull, /* the socket's send buffer is full (EAGAIN): wait for writability */
+    QueueFull /* the interface queue is full (ENOBUFS, with set_local_errors()) */
+  };
+
+  /* the same sends, reporting a full local queue instead of throwing */
+  SendResult try_sendto( const Address & peer, const std::string & payload );
+  SendResult try_send( const std::string & payload );
+  SendResult try_send_segments( const std::string & buffer, const uint16_t segment_size );
+
+  /* most segments and bytes the kernel will split from one buffer */
+  static const size_t MAX_GSO_SEGMENTS = 64;
+  static const size_t MAX_GSO_BYTES = 65507;
+
   /* turn on timestamps on receipt */
   void set_timestamps();
+
+  /* let the kernel coalesce consecutive datagrams into one receive (UDP GRO) */
+  void set_gro();
+
+  /* mark outgoing datagrams with this ECN codepoint (over IPv4 or IPv6) */
+  void set_ecn( const ECN codepoint );
+
+  /* report the ECN codepoint of each received datagram */
+  void set_receive_ecn();
+
+  /* fail sends the interface queue drops with ENOBUFS, rather than
+     dropping them silently (this also queues ICMP errors on the socket) */
+  void set_local_errors();
 };
 
 /* TCP socket */
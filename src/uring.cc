@@ -0,0 +1,320 @@
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <netinet/udp.h>
+
+#include "uring.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* tags in the user_data of each submission */
+static const uint64_t RECEIVE_TAG = uint64_t( 1 ) << 63;
+
+/* helpers to read and write the indices shared with the kernel */
+static inline unsigned int load_acquire( const unsigned int * const p )
+{
+  return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+static inline void store_release( unsigned int * const p, const unsigned int value )
+{
+  __atomic_store_n( p, value, __ATOMIC_RELEASE );
+}
+
+template <typename T>
+static T * ring_field( const MMapRegion & region, const size_t offset )
+{
+  return reinterpret_cast<T *>( region.addr() + offset );
+}
+
+static int io_uring_setup( const unsigned int entries, io_uring_params & params )
+{
+  return SystemCall( "io_uring_setup", syscall( __NR_io_uring_setup, entries, &params ) );
+}
+
+IOUring::IOUring( const unsigned int entries )
+  : params_(),
+    fd_( io_uring_setup( entries, params_ ) ),
+    sq_ring_( params_.sq_off.array + params_.sq_entries * sizeof( unsigned int ),
+	      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_.fd_num(), IORING_OFF_SQ_RING ),
+    cq_ring_( params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ),
+	      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_.fd_num(), IORING_OFF_CQ_RING ),
+    sqes_( params_.sq_entries * sizeof( io_uring_sqe ),
+	   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_.fd_num(), IORING_OFF_SQES ),
+    sq_head_( ring_field<unsigned int>( sq_ring_, params_.sq_off.head ) ),
+    sq_tail_( ring_field<unsigned int>( sq_ring_, params_.sq_off.tail ) ),
+    sq_array_( ring_field<unsigned int>( sq_ring_, params_.sq_off.array ) ),
+    sq_mask_( *ring_field<unsigned int>( sq_ring_, params_.sq_off.ring_mask ) ),
+    sqes_base_( ring_field<io_uring_sqe>( sqes_, 0 ) ),
+    sq_local_tail_( *sq_tail_ ),
+    cq_head_( ring_field<unsigned int>( cq_ring_, params_.cq_off.head ) ),
+    cq_tail_( ring_field<unsigned int>( cq_ring_, params_.cq_off.tail ) ),
+    cq_mask_( *ring_field<unsigned int>( cq_ring_, params_.cq_off.ring_mask ) ),
+    cqes_base_( ring_field<io_uring_cqe>( cq_ring_, params_.cq_off.cqes ) )
+{}
+
+/* a zeroed submission queue entry (submits first if the queue is full) */
+io_uring_sqe & IOUring::prepare()
+{
+  if ( sq_local_tail_ - load_acquire( sq_head_ ) >= params_.sq_entries ) {
+    submit();
+  }
+
+  const unsigned int index = sq_local_tail_ & sq_mask_;
+  io_uring_sqe & sqe = sqes_base_[ index ];
+  zero( sqe );
+  sq_array_[ index ] = index;
+  sq_local_tail_++;
+
+  return sqe;
+}
+
+/* number of prepared entries not yet submitted */
+unsigned int IOUring::pending() const
+{
+  return sq_local_tail_ - *sq_tail_;
+}
+
+/* hand every prepared entry to the kernel in one syscall,
+   optionally waiting for at least min_complete completions */
+void IOUring::submit( const unsigned int min_complete )
+{
+  const unsigned int to_submit = pending();
+  if ( to_submit == 0 and min_complete == 0 ) {
+    return;
+  }
+
+  store_release( sq_tail_, sq_local_tail_ );
+
+  SystemCall( "io_uring_enter",
+	      syscall( __NR_io_uring_enter, fd_.fd_num(), to_submit, min_complete,
+		       min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0 ) );
+}
+
+/* call function on each waiting completion, then release them */
+unsigned int IOUring::complete( const function<void(const io_uring_cqe &)> & function )
+{
+  unsigned int head = *cq_head_, count = 0;
+  const unsigned int tail = load_acquire( cq_tail_ );
+
+  for ( ; head != tail; head++, count++ ) {
+    function( cqes_base_[ head & cq_mask_ ] );
+  }
+
+  store_release( cq_head_, head );
+  return count;
+}
+
+/* register a ring of provided buffers as buffer group bgid */
+void IOUring::register_buffer_ring( const MMapRegion & ring, const unsigned int entries,
+				    const unsigned int bgid )
+{
+  io_uring_buf_reg registration;
+  zero( registration );
+  registration.ring_addr = reinterpret_cast<uint64_t>( ring.addr() );
+  registration.ring_entries = entries;
+  registration.bgid = bgid;
+
+  SystemCall( "io_uring_register (PBUF_RING)",
+	      syscall( __NR_io_uring_register, fd_.fd_num(), IORING_REGISTER_PBUF_RING,
+		       &registration, 1 ) );
+}
+
+UringUDPSocket::UringUDPSocket( UDPSocket & socket, const HandlerType & handler,
+				const unsigned int buffer_count, const size_t buffer_size )
+  : socket_( socket ),
+    ring_( 2 * buffer_count ),
+    handler_( handler ),
+    buffer_count_( buffer_count ),
+    buffer_size_( buffer_size ),
+    buffer_ring_( buffer_count * sizeof( io_uring_buf ), PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE ),
+    buffers_( buffer_count * buffer_size, PROT_READ | PROT_WRITE,
+	      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE ),
+    buffer_ring_tail_( 0 ),
+    receive_header_(),
+    send_slots_( buffer_count ),
+    free_send_slots_()
+{
+  if ( buffer_count & (buffer_count - 1) ) {
+    throw runtime_error( "io_uring buffer count must be a power of two" );
+  }
+
+  /* hand every receive buffer to the kernel */
+  ring_.register_buffer_ring( buffer_ring_, buffer_count_, BUFFER_GROUP );
+  for ( unsigned int i = 0; i < buffer_count_; i++ ) {
+    recycle_buffer( i );
+  }
+
+  /* each buffer starts with room for the source address and the
+     control messages (timestamp, GRO segment size and TOS) */
+  receive_header_.msg_namelen = sizeof( Address::raw );
+  receive_header_.msg_controllen = CONTROL_SIZE;
+
+  for ( unsigned int i = 0; i < send_slots_.size(); i++ ) {
+    free_send_slots_.push_back( i );
+  }
+
+  arm_receive();
+  ring_.submit();
+}
+
+/* post a multishot receive that stays armed across completions */
+void UringUDPSocket::arm_receive()
+{
+  io_uring_sqe & sqe = ring_.prepare();
+  sqe.opcode = IORING_OP_RECVMSG;
+  sqe.fd = socket_.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( &receive_header_ );
+  sqe.len = 1;
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = BUFFER_GROUP;
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.user_data = RECEIVE_TAG;
+}
+
+/* return a receive buffer to the provided buffer ring */
+void UringUDPSocket::recycle_buffer( const uint16_t buffer_id )
+{
+  io_uring_buf * const ring = reinterpret_cast<io_uring_buf *>( buffer_ring_.addr() );
+  io_uring_buf & entry = ring[ buffer_ring_tail_ & (buffer_count_ - 1) ];
+  entry.addr = reinterpret_cast<uint64_t>( buffers_.addr() + buffer_id * buffer_size_ );
+  entry.len = buffer_size_;
+  entry.bid = buffer_id;
+
+  buffer_ring_tail_++;
+
+  /* the ring's tail overlays the reserved field of its first entry */
+  __atomic_store_n( &reinterpret_cast<io_uring_buf_ring *>( buffer_ring_.addr() )->tail,
+		    buffer_ring_tail_, __ATOMIC_RELEASE );
+}
+
+/* unpack a received datagram from its buffer and hand it to the handler */
+void UringUDPSocket::receive_completed( const io_uring_cqe & cqe )
+{
+  if ( not (cqe.flags & IORING_CQE_F_MORE) ) {
+    /* the multishot receive ended (e.g. out of buffers), so repost it */
+    arm_receive();
+  }
+
+  if ( cqe.res < 0 ) {
+    if ( cqe.res == -ENOBUFS ) {
+      return;
+    }
+    throw unix_error( "io_uring recvmsg", -cqe.res );
+  }
+
+  if ( not (cqe.flags & IORING_CQE_F_BUFFER) ) {
+    throw runtime_error( "io_uring recvmsg completed without a buffer" );
+  }
+
+  const uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  const char * const buffer = reinterpret_cast<char *>( buffers_.addr() + buffer_id * buffer_size_ );
+
+  /* layout: io_uring_recvmsg_out, source address, control messages, payload */
+  io_uring_recvmsg_out out;
+  memcpy( &out, buffer, sizeof( out ) );
+
+  if ( out.flags & MSG_TRUNC ) {
+    throw runtime_error( "io_uring recvmsg (oversized datagram)" );
+  }
+
+  const char * const name = buffer + sizeof( out );
+  const char * const control = name + receive_header_.msg_namelen;
+  const char * const payload = control + receive_header_.msg_controllen;
+
+  msghdr header;
+  zero( header );
+  header.msg_control = const_cast<char *>( control );
+  header.msg_controllen = out.controllen;
+
+  uint64_t timestamp = -1;
+  int segment_size = 0;
+  ECN ecn = ECN::NotECT;
+  for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &header ); cmsg; cmsg = CMSG_NXTHDR( &header, cmsg ) ) {
+    if ( cmsg->cmsg_level == SOL_SOCKET and cmsg->cmsg_type == SO_TIMESTAMPNS ) {
+      timespec kernel_time;
+      memcpy( &kernel_time, CMSG_DATA( cmsg ), sizeof( kernel_time ) );
+      timestamp = timestamp_ms( kernel_time );
+    } else if ( cmsg->cmsg_level == SOL_UDP and cmsg->cmsg_type == UDP_GRO ) {
+      memcpy( &segment_size, CMSG_DATA( cmsg ), sizeof( segment_size ) );
+    } else {
+      ecn = received_ecn( *cmsg, ecn );
+    }
+  }
+
+  Address::raw source_raw;
+  const size_t source_size = min( size_t( out.namelen ), sizeof( source_raw ) );
+  memcpy( &source_raw, name, source_size );
+  const Address source( source_raw, source_size );
+
+  handler_( { source, timestamp, payload, out.payloadlen, uint16_t( segment_size ), ecn } );
+
+  recycle_buffer( buffer_id );
+}
+
+/* queue a send, falling back to a direct send if every slot is in flight */
+void UringUDPSocket::queue_send( const Address * const destination, const string & payload )
+{
+  if ( free_send_slots_.empty() or payload.size() > sizeof( SendSlot::payload ) ) {
+    if ( destination ) {
+      socket_.sendto( *destination, payload );
+    } else {
+      socket_.send( payload );
+    }
+    return;
+  }
+
+  const unsigned int slot_index = free_send_slots_.back();
+  free_send_slots_.pop_back();
+  SendSlot & slot = send_slots_[ slot_index ];
+
+  memcpy( slot.payload, payload.data(), payload.size() );
+  zero( slot.header );
+  slot.msg_iovec.iov_base = slot.payload;
+  slot.msg_iovec.iov_len = payload.size();
+  slot.header.msg_iov = &slot.msg_iovec;
+  slot.header.msg_iovlen = 1;
+
+  if ( destination ) {
+    memcpy( &slot.destination, &destination->to_sockaddr(), destination->size() );
+    slot.header.msg_name = &slot.destination;
+    slot.header.msg_namelen = destination->size();
+  }
+
+  io_uring_sqe & sqe = ring_.prepare();
+  sqe.opcode = IORING_OP_SENDMSG;
+  sqe.fd = socket_.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( &slot.header );
+  sqe.len = 1;
+  sqe.user_data = slot_index;
+}
+
+/* queue a datagram to the connected address */
+void UringUDPSocket::send( const string & payload )
+{
+  queue_send( nullptr, payload );
+}
+
+/* queue a datagram to the specified address */
+void UringUDPSocket::sendto( const Address & destination, const string & payload )
+{
+  queue_send( &destination, payload );
+}
+
+/* deliver waiting receives to the handler and retire finished sends */
+void UringUDPSocket::process_completions()
+{
+  ring_.complete( [&] ( const io_uring_cqe & cqe ) {
+      if ( cqe.user_data == RECEIVE_TAG ) {
+	receive_completed( cqe );
+	return;
+      }
+
+      free_send_slots_.push_back( cqe.user_data );
+      if ( cqe.res < 0 ) {
+	throw unix_error( "io_uring sendmsg", -cqe.res );
+      }
+    } );
+}
@@ -0,0 +1,140 @@
+#ifndef URING_HH
+#define URING_HH
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <linux/io_uring.h>
+
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+#include "socket.hh"
+
+/* An io_uring instance (set up with raw syscalls). The ring's file
+   descriptor is readable whenever completions are waiting, so it can
+   be driven by a Poller like any other fd. */
+class IOUring
+{
+private:
+  io_uring_params params_;
+  FileDescriptor fd_;
+
+  MMapRegion sq_ring_, cq_ring_, sqes_;
+
+  /* submission queue */
+  unsigned int * sq_head_, * sq_tail_, * sq_array_;
+  unsigned int sq_mask_;
+  io_uring_sqe * sqes_base_;
+  unsigned int sq_local_tail_; /* entries prepared but not yet submitted */
+
+  /* completion queue */
+  unsigned int * cq_head_, * cq_tail_;
+  unsigned int cq_mask_;
+  io_uring_cqe * cqes_base_;
+
+public:
+  IOUring( const unsigned int entries );
+
+  /* the ring's file descriptor */
+  FileDescriptor & fd() { return fd_; }
+
+  /* a zeroed submission queue entry (submits first if the queue is full) */
+  io_uring_sqe & prepare();
+
+  /* hand every prepared entry to the kernel in one syscall,
+     optionally waiting for at least min_complete completions */
+  void submit( const unsigned int min_complete = 0 );
+
+  /* number of prepared entries not yet submitted */
+  unsigned int pending() const;
+
+  /* call function on each waiting completion, then release them */
+  unsigned int complete( const std::function<void(const io_uring_cqe &)> & function );
+
+  /* register a ring of provided buffers as buffer group bgid */
+  void register_buffer_ring( const MMapRegion & ring, const unsigned int entries,
+			     const unsigned int bgid );
+
+  /* forbid copying or assigning */
+  IOUring( const IOUring & other ) = delete;
+  IOUring & operator=( const IOUring & other ) = delete;
+};
+
+/* UDP datagram I/O through io_uring: a multishot receive stays posted on
+   the socket and fills buffers from a provided buffer ring, and sends are
+   queued and submitted in batches with one syscall */
+class UringUDPSocket
+{
+public:
+  /* a received datagram, valid only during the handler call */
+  struct received_datagram_view {
+    const Address & source_address;
+    uint64_t timestamp;
+    const char * data;
+    size_t length;
+    uint16_t segment_size; /* if nonzero, data holds several datagrams of this size (GRO) */
+    ECN ecn; /* NotECT unless the socket reports ECN */
+  };
+
+  typedef std::function<void(const received_datagram_view &)> HandlerType;
+
+private:
+  /* a send in flight: the kernel reads these until it completes */
+  struct SendSlot {
+    msghdr header;
+    iovec msg_iovec;
+    Address::raw destination;
+    char payload[ 2048 ];
+  };
+
+  static const unsigned int BUFFER_GROUP = 0;
+  static const size_t CONTROL_SIZE = 96;
+
+  UDPSocket & socket_;
+  IOUring ring_;
+  HandlerType handler_;
+
+  /* provided receive buffers */
+  unsigned int buffer_count_;
+  size_t buffer_size_;
+  MMapRegion buffer_ring_, buffers_;
+  uint16_t buffer_ring_tail_;
+  msghdr receive_header_; /* sizes of the name and control areas of each buffer */
+
+  /* sends in flight */
+  std::vector<SendSlot> send_slots_;
+  std::vector<unsigned int> free_send_slots_;
+
+  void arm_receive();
+  void recycle_buffer( const uint16_t buffer_id );
+  void receive_completed( const io_uring_cqe & cqe );
+  void queue_send( const Address * const destination, const std::string & payload );
+
+public:
+  UringUDPSocket( UDPSocket & socket, const HandlerType & handler,
+		  const unsigned int buffer_count = 256, const size_t buffer_size = 2048 );
+
+  /* queue a datagram to the connected address */
+  void send( const std::string & payload );
+
+  /* queue a datagram to the specified address */
+  void sendto( const Address & destination, const std::string & payload );
+
+  /* submit every queued send in one syscall */
+  void submit() { ring_.submit(); }
+
+  /* deliver waiting receives to the handler and retire finished sends */
+  void process_completions();
+
+  /* the fd to poll for completions */
+  FileDescriptor & completion_fd() { return ring_.fd(); }
+
+  /* forbid copying or assigning */
+  UringUDPSocket( const UringUDPSocket & other ) = delete;
+  UringUDPSocket & operator=( const UringUDPSocket & other ) = delete;
+};
+
+#endif /* URING_HH */
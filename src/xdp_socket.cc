@@ -0,0 +1,536 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_ether.h>
+
+#include "xdp_socket.hh"
+#include "timestamp.hh"
+#include "util.hh"
+
+using namespace std;
+
+/* helpers to read and write the indices shared with the kernel */
+static inline uint32_t load_acquire( const uint32_t * const p )
+{
+  return __atomic_load_n( p, __ATOMIC_ACQUIRE );
+}
+
+static inline void store_release( uint32_t * const p, const uint32_t value )
+{
+  __atomic_store_n( p, value, __ATOMIC_RELEASE );
+}
+
+template <typename Entry>
+XDPRing<Entry>::XDPRing( const int fd, const xdp_ring_offset & offsets,
+			 const uint32_t size, const off_t page_offset )
+  : region_( offsets.desc + size * sizeof( Entry ), PROT_READ | PROT_WRITE,
+	     MAP_SHARED | MAP_POPULATE, fd, page_offset ),
+    producer_( reinterpret_cast<uint32_t *>( region_.addr() + offsets.producer ) ),
+    consumer_( reinterpret_cast<uint32_t *>( region_.addr() + offsets.consumer ) ),
+    entries_( reinterpret_cast<Entry *>( region_.addr() + offsets.desc ) ),
+    mask_( size - 1 )
+{}
+
+template <typename Entry>
+uint32_t XDPRing<Entry>::space() const
+{
+  return mask_ + 1 - (*producer_ - load_acquire( consumer_ ));
+}
+
+template <typename Entry>
+void XDPRing<Entry>::push( const Entry & entry )
+{
+  const uint32_t producer = *producer_;
+  entries_[ producer & mask_ ] = entry;
+  store_release( producer_, producer + 1 );
+}
+
+template <typename Entry>
+uint32_t XDPRing<Entry>::waiting() const
+{
+  return load_acquire( producer_ ) - *consumer_;
+}
+
+template <typename Entry>
+Entry XDPRing<Entry>::pop()
+{
+  const uint32_t consumer = *consumer_;
+  const Entry entry = entries_[ consumer & mask_ ];
+  store_release( consumer_, consumer + 1 );
+  return entry;
+}
+
+template class XDPRing<uint64_t>;
+template class XDPRing<xdp_desc>;
+
+/* error-checking wrapper for the bpf syscall */
+static int bpf( const char * const attempt, const int command, bpf_attr & attr )
+{
+  return SystemCall( attempt, syscall( __NR_bpf, command, &attr, sizeof( attr ) ) );
+}
+
+static bpf_insn instruction( const uint8_t code, const uint8_t dst, const uint8_t src,
+			     const int16_t offset, const int32_t immediate )
+{
+  bpf_insn ret;
+  zero( ret );
+  ret.code = code;
+  ret.dst_reg = dst;
+  ret.src_reg = src;
+  ret.off = offset;
+  ret.imm = immediate;
+  return ret;
+}
+
+static unsigned int interface_index( const string & interface )
+{
+  const unsigned int ret = if_nametoindex( interface.c_str() );
+  if ( ret == 0 ) {
+    throw unix_error( "if_nametoindex (" + interface + ")" );
+  }
+  return ret;
+}
+
+static XDPSocket::MACAddress interface_mac( const string & interface )
+{
+  FileDescriptor probe( SystemCall( "socket", socket( AF_INET, SOCK_DGRAM, 0 ) ) );
+  ifreq request;
+  zero( request );
+  strncpy( request.ifr_name, interface.c_str(), IFNAMSIZ - 1 );
+  SystemCall( "ioctl SIOCGIFHWADDR", ioctl( probe.fd_num(), SIOCGIFHWADDR, &request ) );
+
+  XDPSocket::MACAddress ret;
+  memcpy( ret.data(), request.ifr_hwaddr.sa_data, ret.size() );
+  return ret;
+}
+
+/* the interface's first IPv4 address (network byte order) */
+static uint32_t interface_ip( const string & interface )
+{
+  ifaddrs * addresses;
+  SystemCall( "getifaddrs", getifaddrs( &addresses ) );
+
+  uint32_t ret = 0;
+  for ( ifaddrs * i = addresses; i; i = i->ifa_next ) {
+    if ( i->ifa_addr and i->ifa_addr->sa_family == AF_INET and interface == i->ifa_name ) {
+      ret = reinterpret_cast<const sockaddr_in *>( i->ifa_addr )->sin_addr.s_addr;
+      break;
+    }
+  }
+
+  freeifaddrs( addresses );
+
+  if ( not ret ) {
+    throw runtime_error( interface + " has no IPv4 address" );
+  }
+  return ret;
+}
+
+/* IPv4 address (network byte order, 0 for a wildcard) and port of an
+   AF_INET or IPv4-mapped AF_INET6 address */
+static pair<uint32_t, uint16_t> ipv4_port( const Address & address )
+{
+  const sockaddr & addr = address.to_sockaddr();
+
+  if ( addr.sa_family == AF_INET ) {
+    const sockaddr_in & in = reinterpret_cast<const sockaddr_in &>( addr );
+    return make_pair( in.sin_addr.s_addr, in.sin_port );
+  }
+
+  if ( addr.sa_family == AF_INET6 ) {
+    const sockaddr_in6 & in6 = reinterpret_cast<const sockaddr_in6 &>( addr );
+    if ( IN6_IS_ADDR_UNSPECIFIED( &in6.sin6_addr ) ) {
+      return make_pair( 0, in6.sin6_port );
+    }
+    if ( IN6_IS_ADDR_V4MAPPED( &in6.sin6_addr ) ) {
+      uint32_t ip;
+      memcpy( &ip, in6.sin6_addr.s6_addr + 12, sizeof( ip ) );
+      return make_pair( ip, in6.sin6_port );
+    }
+  }
+
+  throw runtime_error( "AF_XDP socket supports only IPv4 addresses, not " + address.to_string() );
+}
+
+static Address make_address( const uint32_t ip, const uint16_t port )
+{
+  sockaddr_in addr;
+  zero( addr );
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = ip;
+  addr.sin_port = port;
+  return Address( reinterpret_cast<const sockaddr &>( addr ), sizeof( addr ) );
+}
+
+/* register the frame area and size the rings, then ask where they live */
+static xdp_mmap_offsets configure_rings( const int fd, const MMapRegion & umem,
+					 const uint32_t frame_size, const uint32_t ring_size )
+{
+  xdp_umem_reg registration;
+  zero( registration );
+  registration.addr = reinterpret_cast<uint64_t>( umem.addr() );
+  registration.len = umem.length();
+  registration.chunk_size = frame_size;
+  SystemCall( "setsockopt XDP_UMEM_REG",
+	      setsockopt( fd, SOL_XDP, XDP_UMEM_REG, &registration, sizeof( registration ) ) );
+
+  for ( const int ring : { XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING } ) {
+    SystemCall( "setsockopt (XDP ring size)",
+		setsockopt( fd, SOL_XDP, ring, &ring_size, sizeof( ring_size ) ) );
+  }
+
+  xdp_mmap_offsets ret;
+  socklen_t length = sizeof( ret );
+  SystemCall( "getsockopt XDP_MMAP_OFFSETS",
+	      getsockopt( fd, SOL_XDP, XDP_MMAP_OFFSETS, &ret, &length ) );
+  return ret;
+}
+
+XDPSocket::XDPSocket( const string & interface, const unsigned int queue )
+  : FileDescriptor( SystemCall( "socket AF_XDP", socket( AF_XDP, SOCK_RAW, 0 ) ) ),
+    interface_( interface ),
+    interface_index_( interface_index( interface ) ),
+    queue_( queue ),
+    local_mac_( interface_mac( interface ) ),
+    umem_( size_t( FRAME_SIZE ) * FRAME_COUNT, PROT_READ | PROT_WRITE,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE ),
+    offsets_( configure_rings( fd_num(), umem_, FRAME_SIZE, RING_SIZE ) ),
+    fill_( fd_num(), offsets_.fr, RING_SIZE, XDP_UMEM_PGOFF_FILL_RING ),
+    completion_( fd_num(), offsets_.cr, RING_SIZE, XDP_UMEM_PGOFF_COMPLETION_RING ),
+    rx_( fd_num(), offsets_.rx, RING_SIZE, XDP_PGOFF_RX_RING ),
+    tx_( fd_num(), offsets_.tx, RING_SIZE, XDP_PGOFF_TX_RING ),
+    free_frames_(),
+    socket_map_(),
+    program_(),
+    link_(),
+    local_ip_( 0 ),
+    peer_ip_( 0 ),
+    local_port_( 0 ),
+    peer_port_( 0 ),
+    peer_mac_(),
+    ip_id_( 0 ),
+    ecn_( ECN::NotECT ),
+    neighbors_()
+{
+  /* the first half of the frames wait in the fill ring for received
+     packets; the second half are for sending */
+  for ( uint32_t i = 0; i < FRAME_COUNT; i++ ) {
+    if ( i < RING_SIZE ) {
+      fill_.push( uint64_t( i ) * FRAME_SIZE );
+    } else {
+      free_frames_.push_back( uint64_t( i ) * FRAME_SIZE );
+    }
+  }
+
+  sockaddr_xdp addr;
+  zero( addr );
+  addr.sxdp_family = AF_XDP;
+  addr.sxdp_ifindex = interface_index_;
+  addr.sxdp_queue_id = queue_;
+  addr.sxdp_flags = XDP_COPY;
+  SystemCall( "bind AF_XDP (" + interface_ + ")",
+	      ::bind( fd_num(), reinterpret_cast<const sockaddr *>( &addr ), sizeof( addr ) ) );
+}
+
+/* load and attach an XDP program that redirects IPv4 UDP datagrams for
+   our port to this socket, and passes everything else to the kernel:
+
+     if ( data + 42 > data_end ) pass
+     if ( ethertype != IPv4 or version/IHL != 0x45 or protocol != UDP ) pass
+     if ( UDP destination port != ours ) pass
+     return bpf_redirect_map( &sockets, rx_queue_index, XDP_PASS ) */
+void XDPSocket::attach_program()
+{
+  bpf_attr attr;
+
+  /* a map from receive queue to AF_XDP socket */
+  zero( attr );
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof( uint32_t );
+  attr.value_size = sizeof( uint32_t );
+  attr.max_entries = queue_ + 1;
+  socket_map_.reset( new FileDescriptor( bpf( "bpf BPF_MAP_CREATE", BPF_MAP_CREATE, attr ) ) );
+
+  const uint32_t key = queue_, value = fd_num();
+  zero( attr );
+  attr.map_fd = socket_map_->fd_num();
+  attr.key = reinterpret_cast<uint64_t>( &key );
+  attr.value = reinterpret_cast<uint64_t>( &value );
+  bpf( "bpf BPF_MAP_UPDATE_ELEM", BPF_MAP_UPDATE_ELEM, attr );
+
+  const int16_t PASS = 19; /* index of the pass instruction */
+  const bpf_insn program[] = {
+    /*  0 */ instruction( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof( xdp_md, data ), 0 ),
+    /*  1 */ instruction( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof( xdp_md, data_end ), 0 ),
+    /*  2 */ instruction( BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0 ),
+    /*  3 */ instruction( BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, HEADERS_SIZE ),
+    /*  4 */ instruction( BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, PASS - 5, 0 ),
+    /*  5 */ instruction( BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0 ),
+    /*  6 */ instruction( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 7, htons( ETH_P_IP ) ),
+    /*  7 */ instruction( BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14, 0 ),
+    /*  8 */ instruction( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 9, 0x45 ),
+    /*  9 */ instruction( BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, 14 + 9, 0 ),
+    /* 10 */ instruction( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 11, IPPROTO_UDP ),
+    /* 11 */ instruction( BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 14 + 20 + 2, 0 ),
+    /* 12 */ instruction( BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, PASS - 13, local_port_ ),
+    /* 13 */ instruction( BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof( xdp_md, rx_queue_index ), 0 ),
+    /* 14 */ instruction( BPF_LD | BPF_IMM | BPF_DW, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, socket_map_->fd_num() ),
+    /* 15 */ instruction( 0, 0, 0, 0, 0 ),
+    /* 16 */ instruction( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS ),
+    /* 17 */ instruction( BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map ),
+    /* 18 */ instruction( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ),
+    /* 19 */ instruction( BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS ),
+    /* 20 */ instruction( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ),
+  };
+
+  static const char license[] = "GPL";
+  char log[ 4096 ] = "";
+  zero( attr );
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = reinterpret_cast<uint64_t>( program );
+  attr.insn_cnt = sizeof( program ) / sizeof( program[ 0 ] );
+  attr.license = reinterpret_cast<uint64_t>( license );
+  attr.log_buf = reinterpret_cast<uint64_t>( log );
+  attr.log_size = sizeof( log );
+  attr.log_level = 1;
+
+  try {
+    program_.reset( new FileDescriptor( bpf( "bpf BPF_PROG_LOAD", BPF_PROG_LOAD, attr ) ) );
+  } catch ( const unix_error & e ) {
+    cerr << log;
+    throw;
+  }
+
+  /* attach through a link, so the program goes away with the socket */
+  zero( attr );
+  attr.link_create.prog_fd = program_->fd_num();
+  attr.link_create.target_ifindex = interface_index_;
+  attr.link_create.attach_type = BPF_XDP;
+  attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+  link_.reset( new FileDescriptor( bpf( "bpf BPF_LINK_CREATE (XDP)", BPF_LINK_CREATE, attr ) ) );
+}
+
+/* take datagrams for this address's port */
+void XDPSocket::bind( const Address & address )
+{
+  const auto ip_port = ipv4_port( address );
+  local_ip_ = ip_port.first ? ip_port.first : interface_ip( interface_ );
+  local_port_ = ip_port.second;
+
+  if ( local_port_ == 0 ) {
+    throw runtime_error( "AF_XDP socket must be bound to a specific port" );
+  }
+
+  attach_program();
+}
+
+/* link-layer address of a neighbor on the interface: learned from its
+   datagrams, or from the kernel's neighbor table (after prompting the
+   kernel to resolve it with a datagram to the discard port) */
+const XDPSocket::MACAddress & XDPSocket::resolve( const uint32_t ip )
+{
+  const auto learned = neighbors_.find( ip );
+  if ( learned != neighbors_.end() ) {
+    return learned->second;
+  }
+
+  char ip_string[ INET_ADDRSTRLEN ];
+  inet_ntop( AF_INET, &ip, ip_string, sizeof( ip_string ) );
+
+  for ( unsigned int attempt = 0; attempt < 100; attempt++ ) {
+    ifstream arp_table( "/proc/net/arp" );
+    string line;
+    getline( arp_table, line ); /* column headings */
+    while ( getline( arp_table, line ) ) {
+      istringstream fields( line );
+      string address, type, flags, mac, mask, device;
+      fields >> address >> type >> flags >> mac >> mask >> device;
+
+      MACAddress ret;
+      if ( address == ip_string and device == interface_ and flags != "0x0"
+	   and 6 == sscanf( mac.c_str(), "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+			    &ret[ 0 ], &ret[ 1 ], &ret[ 2 ], &ret[ 3 ], &ret[ 4 ], &ret[ 5 ] ) ) {
+	return neighbors_[ ip ] = ret;
+      }
+    }
+
+    if ( attempt == 0 ) {
+      UDPSocket prompt;
+      prompt.sendto( Address( ip_string, 9 ), "" );
+    }
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  }
+
+  throw runtime_error( string( "could not resolve the link-layer address of " ) + ip_string
+		       + " on " + interface_ );
+}
+
+/* set the default destination and look up its link-layer address */
+void XDPSocket::connect( const Address & address )
+{
+  const auto ip_port = ipv4_port( address );
+  peer_ip_ = ip_port.first;
+  peer_port_ = ip_port.second;
+  peer_mac_ = resolve( peer_ip_ );
+
+  if ( not local_ip_ ) {
+    local_ip_ = interface_ip( interface_ );
+  }
+}
+
+Address XDPSocket::local_address() const { return make_address( local_ip_, local_port_ ); }
+Address XDPSocket::peer_address() const { return make_address( peer_ip_, peer_port_ ); }
+
+/* receive a datagram and where it came from */
+UDPSocket::received_datagram XDPSocket::recv()
+{
+  char payload[ FRAME_SIZE ];
+  Address source;
+  const UDPSocket::received_view recd = recv_into( payload, sizeof( payload ), &source );
+
+  return { source, recd.timestamp, string( payload, recd.length ), 0, recd.ecn };
+}
+
+/* receive a datagram into the caller's buffer */
+UDPSocket::received_view XDPSocket::recv_into( char * const buffer, const size_t capacity,
+					       Address * const source )
+{
+  while ( not rx_.waiting() ) {
+    pollfd pfd { fd_num(), POLLIN, 0 };
+    SystemCall( "poll", ::poll( &pfd, 1, -1 ) );
+  }
+
+  const xdp_desc desc = rx_.pop();
+  const uint8_t * const frame = umem_.addr() + desc.addr;
+  register_read();
+
+  /* the XDP program has checked the headers are present, IPv4 without
+     options, UDP, and for our port */
+  uint16_t udp_length;
+  memcpy( &udp_length, frame + 14 + 20 + 4, sizeof( udp_length ) );
+  const size_t payload_length = min( size_t( max( ntohs( udp_length ), uint16_t( 8 ) ) ) - 8,
+				     size_t( desc.len ) - HEADERS_SIZE );
+
+  uint32_t source_ip;
+  memcpy( &source_ip, frame + 14 + 12, sizeof( source_ip ) );
+  const ECN ecn = ECN( frame[ 14 + 1 ] & 0x03 );
+
+  MACAddress source_mac;
+  memcpy( source_mac.data(), frame + 6, source_mac.size() );
+  neighbors_.emplace( source_ip, source_mac );
+
+  if ( source ) {
+    uint16_t source_port;
+    memcpy( &source_port, frame + 14 + 20, sizeof( source_port ) );
+    *source = make_address( source_ip, source_port );
+  }
+
+  if ( payload_length > capacity ) {
+    fill_.push( desc.addr - desc.addr % FRAME_SIZE );
+    throw runtime_error( "AF_XDP recv (oversized datagram)" );
+  }
+  memcpy( buffer, frame + HEADERS_SIZE, payload_length );
+
+  /* hand the frame back for another packet */
+  fill_.push( desc.addr - desc.addr % FRAME_SIZE );
+
+  return { payload_length, timestamp_ms(), 0, ecn };
+}
+
+/* return sent frames to the free list */
+void XDPSocket::reclaim_frames()
+{
+  for ( uint32_t i = completion_.waiting(); i > 0; i-- ) {
+    free_frames_.push_back( completion_.pop() );
+  }
+}
+
+/* ask the kernel to transmit what is on the tx ring */
+void XDPSocket::kick()
+{
+  if ( ::sendto( fd_num(), nullptr, 0, MSG_DONTWAIT, nullptr, 0 ) < 0
+       and errno != EAGAIN and errno != EBUSY and errno != ENOBUFS ) {
+    throw unix_error( "sendto (AF_XDP transmit)" );
+  }
+  register_write();
+}
+
+/* frame a datagram and transmit it */
+void XDPSocket::send_frame( const uint32_t ip, const uint16_t port, const MACAddress & mac,
+			    const string & payload )
+{
+  if ( payload.size() > FRAME_SIZE - HEADERS_SIZE ) {
+    throw runtime_error( "AF_XDP sendto (oversized datagram)" );
+  }
+
+  reclaim_frames();
+  while ( free_frames_.empty() or not tx_.space() ) {
+    kick();
+    reclaim_frames();
+  }
+
+  const uint64_t frame_address = free_frames_.back();
+  free_frames_.pop_back();
+  uint8_t * const frame = umem_.addr() + frame_address;
+
+  /* Ethernet */
+  memcpy( frame, mac.data(), mac.size() );
+  memcpy( frame + 6, local_mac_.data(), local_mac_.size() );
+  const uint16_t ethertype = htons( ETH_P_IP );
+  memcpy( frame + 12, &ethertype, sizeof( ethertype ) );
+
+  /* IPv4, with don't-fragment set */
+  uint8_t * const ip_header = frame + 14;
+  const uint16_t ip_fields[ 5 ] = { htons( 0x4500 | uint16_t( ecn_ ) ), htons( 20 + 8 + payload.size() ),
+				    htons( ip_id_++ ), htons( 0x4000 ),
+				    htons( (64 << 8) | IPPROTO_UDP ) };
+  memcpy( ip_header, ip_fields, sizeof( ip_fields ) );
+  memset( ip_header + 10, 0, 2 );
+  memcpy( ip_header + 12, &local_ip_, sizeof( local_ip_ ) );
+  memcpy( ip_header + 16, &ip, sizeof( ip ) );
+
+  /* ones'-complement sum of the header's 16-bit words */
+  uint32_t sum = 0;
+  for ( unsigned int i = 0; i < 20; i += 2 ) {
+    uint16_t word;
+    memcpy( &word, ip_header + i, sizeof( word ) );
+    sum += word;
+  }
+  sum = (sum & 0xffff) + (sum >> 16);
+  sum = (sum & 0xffff) + (sum >> 16);
+  const uint16_t checksum = ~sum;
+  memcpy( ip_header + 10, &checksum, sizeof( checksum ) );
+
+  /* UDP, with no checksum (allowed over IPv4) */
+  const uint16_t udp_fields[ 4 ] = { local_port_, port, htons( 8 + payload.size() ), 0 };
+  memcpy( ip_header + 20, udp_fields, sizeof( udp_fields ) );
+
+  memcpy( frame + HEADERS_SIZE, payload.data(), payload.size() );
+
+  tx_.push( { frame_address, uint32_t( HEADERS_SIZE + payload.size() ), 0 } );
+  kick();
+}
+
+/* send datagram to specified address */
+void XDPSocket::sendto( const Address & destination, const string & payload )
+{
+  const auto ip_port = ipv4_port( destination );
+  send_frame( ip_port.first, ip_port.second, resolve( ip_port.first ), payload );
+}
+
+/* send datagram to the connected address */
+void XDPSocket::send( const string & payload )
+{
+  send_frame( peer_ip_, peer_port_, peer_mac_, payload );
+}
@@ -0,0 +1,125 @@
+#ifndef XDP_SOCKET_HH
+#define XDP_SOCKET_HH
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <linux/if_xdp.h>
+
+#include "address.hh"
+#include "file_descriptor.hh"
+#include "mmap_region.hh"
+#include "socket.hh"
+
+/* one of the four rings an AF_XDP socket shares with the kernel */
+template <typename Entry>
+class XDPRing
+{
+private:
+  MMapRegion region_;
+  uint32_t * producer_, * consumer_;
+  Entry * entries_;
+  uint32_t mask_;
+
+public:
+  XDPRing( const int fd, const xdp_ring_offset & offsets,
+	   const uint32_t size, const off_t page_offset );
+
+  /* as producer (fill and tx rings): free slots, and add one entry */
+  uint32_t space() const;
+  void push( const Entry & entry );
+
+  /* as consumer (rx and completion rings): waiting entries, and take one */
+  uint32_t waiting() const;
+  Entry pop();
+
+  /* forbid copying or assigning */
+  XDPRing( const XDPRing & other ) = delete;
+  XDPRing & operator=( const XDPRing & other ) = delete;
+};
+
+/* UDP over an AF_XDP socket (IPv4 only): datagrams for the bound port are
+   steered to the socket by a small XDP program and skip the kernel's IP and
+   UDP stack; outgoing datagrams are framed here and handed to the device.
+   Copy mode with the generic XDP hook works on any device, including veth
+   pairs. The peer must be on the interface's link (there is no routing). */
+class XDPSocket : public FileDescriptor
+{
+public:
+  typedef std::array<uint8_t, 6> MACAddress;
+
+private:
+  static const uint32_t FRAME_SIZE = 2048;
+  static const uint32_t FRAME_COUNT = 4096; /* half for receiving, half for sending */
+  static const uint32_t RING_SIZE = FRAME_COUNT / 2;
+  static const size_t HEADERS_SIZE = 14 + 20 + 8; /* Ethernet, IPv4, UDP */
+
+  std::string interface_;
+  unsigned int interface_index_, queue_;
+  MACAddress local_mac_;
+
+  /* frames shared with the kernel, and the rings that pass them back and forth */
+  MMapRegion umem_;
+  xdp_mmap_offsets offsets_;
+  XDPRing<uint64_t> fill_, completion_;
+  XDPRing<xdp_desc> rx_, tx_;
+  std::vector<uint64_t> free_frames_; /* frames available for sending */
+
+  /* the XDP program that steers our datagrams to the socket
+     (attached while the socket is bound) */
+  std::unique_ptr<FileDescriptor> socket_map_, program_, link_;
+
+  /* addresses in network byte order */
+  uint32_t local_ip_, peer_ip_;
+  uint16_t local_port_, peer_port_;
+  MACAddress peer_mac_;
+  uint16_t ip_id_;
+  ECN ecn_; /* codepoint for sent datagrams */
+  std::unordered_map<uint32_t, MACAddress> neighbors_; /* learned from received frames */
+
+  void attach_program();
+  const MACAddress & resolve( const uint32_t ip );
+  void reclaim_frames();
+  void kick();
+  void send_frame( const uint32_t ip, const uint16_t port, const MACAddress & mac,
+		   const std::string & payload );
+
+public:
+  /* open an AF_XDP socket on one receive queue of the named interface */
+  XDPSocket( const std::string & interface, const unsigned int queue = 0 );
+
+  /* take datagrams for this address's port (if the address is a wildcard,
+     the interface's own IPv4 address is the source of sent datagrams) */
+  void bind( const Address & address );
+
+  /* set the default destination and look up its link-layer address */
+  void connect( const Address & address );
+
+  /* receive a datagram (timestamped when dequeued, as there is
+     no kernel timestamp) and where it came from */
+  UDPSocket::received_datagram recv();
+
+  /* receive a datagram into the caller's buffer, recording where it
+     came from only if source is given */
+  UDPSocket::received_view recv_into( char * const buffer, const size_t capacity,
+				      Address * const source = nullptr );
+
+  /* send datagram to specified address */
+  void sendto( const Address & peer, const std::string & payload );
+
+  /* send datagram to the connected address */
+  void send( const std::string & payload );
+
+  /* mark sent datagrams with this ECN codepoint */
+  void set_ecn( const ECN codepoint ) { ecn_ = codepoint; }
+
+  /* accessors */
+  Address local_address() const;
+  Address peer_address() const;
+};
+
+#endif /* XDP_SOCKET_HH */